@@ -40,6 +40,8 @@ struct Region {
 
 typedef struct {
     Region *begin, *end;
+    // Peak number of words in use, see arena_reset_fit()
+    size_t high_water;
 } Arena;
 
 typedef struct {
@@ -49,20 +51,22 @@ typedef struct {
 
 #define REGION_DEFAULT_CAPACITY (8 * 1024)
 
-/* Region *new_region(size_t capacity); */
-/* void free_region(Region *r); */
+Region *new_region(size_t capacity);
+void free_region(Region *r);
 
-/* void *arena_alloc(Arena *a, size_t size_bytes); */
-/* void *arena_realloc(Arena *a, void *oldptr, size_t oldsz, size_t newsz); */
-/* char *arena_strdup(Arena *a, const char *cstr); */
-/* void *arena_memdup(Arena *a, void *data, size_t size); */
-/* char *arena_sprintf(Arena *a, const char *format, ...); */
+void *arena_alloc(Arena *a, size_t size_bytes);
+void *arena_realloc(Arena *a, void *oldptr, size_t oldsz, size_t newsz);
+char *arena_strdup(Arena *a, const char *cstr);
+void *arena_memdup(Arena *a, void *data, size_t size);
+char *arena_sprintf(Arena *a, const char *format, ...);
+int arena_owns(Arena *a, const void *ptr);
 
-/* Arena_Mark arena_snapshot(Arena *a); */
-/* void arena_reset(Arena *a); */
-/* void arena_rewind(Arena *a, Arena_Mark m); */
-/* void arena_free(Arena *a); */
-/* void arena_trim(Arena *a); */
+Arena_Mark arena_snapshot(Arena *a);
+void arena_reset(Arena *a);
+void arena_reset_fit(Arena *a);
+void arena_rewind(Arena *a, Arena_Mark m);
+void arena_free(Arena *a);
+void arena_trim(Arena *a);
 
 #define ARENA_DA_INIT_CAP 256
 
@@ -84,6 +88,8 @@ typedef struct {
         (da)->items[(da)->count++] = (item);                                                                           \
     } while (0)
 
+#ifdef ARENA_IMPLEMENTATION
+
 // TODO: instead of accepting specific capacity new_region() should accept the size of the object we want to fit into
 // the region It should be up to new_region() to decide the actual capacity to allocate
 Region *new_region(size_t capacity)
@@ -202,6 +208,40 @@ void arena_reset(Arena *a)
     a->end = a->begin;
 }
 
+// Rewinds the arena like arena_reset(), but also records the peak usage. If
+// that didn't fit into the first region, the regions are replaced by a single
+// one big enough for it, so an arena reused for similar workloads stops
+// calling malloc.
+void arena_reset_fit(Arena *a)
+{
+    size_t used = 0;
+    for (Region *r = a->begin; r != NULL; r = r->next) {
+        used += r->count;
+    }
+    if (used > a->high_water)
+        a->high_water = used;
+
+    if (a->begin != NULL && (a->begin->next != NULL || a->begin->capacity < a->high_water)) {
+        size_t capacity = REGION_DEFAULT_CAPACITY;
+        if (capacity < a->high_water)
+            capacity = a->high_water;
+        arena_free(a);
+        a->begin = new_region(capacity);
+        a->end = a->begin;
+    }
+
+    arena_reset(a);
+}
+
+int arena_owns(Arena *a, const void *ptr)
+{
+    for (Region *r = a->begin; r != NULL; r = r->next) {
+        if ((const uintptr_t *)ptr >= r->data && (const uintptr_t *)ptr < r->data + r->capacity)
+            return 1;
+    }
+    return 0;
+}
+
 void arena_rewind(Arena *a, Arena_Mark m)
 {
     if (m.region == NULL) { // snapshot of uninitialized arena
@@ -239,3 +279,5 @@ void arena_trim(Arena *a)
     }
     a->end->next = NULL;
 }
+
+#endif // ARENA_IMPLEMENTATION
@@ -0,0 +1,101 @@
+/*
+ * Compares /proc scan backends on the same process forest:
+ *
+ *   bench-pstree [<processes> [<iterations>]]
+ */
+#define _GNU_SOURCE
+#include "freezer.h"
+#include <glib.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define FANOUT 4
+
+static const char *backends[] = {"io_uring", "threads", "sync"};
+
+/* forks n processes below the caller, FANOUT children per node, then sleeps forever */
+static void spawn_tree(int n)
+{
+    int per_child = n / FANOUT;
+    int extra = n % FANOUT;
+    for (int i = 0; i < FANOUT && n > 0; i++) {
+        int size = per_child + (i < extra);
+        if (!size)
+            continue;
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            exit(1);
+        }
+        if (!pid) {
+            prctl(PR_SET_PDEATHSIG, SIGKILL);
+            spawn_tree(size - 1);
+        }
+    }
+    while (true)
+        pause();
+}
+
+static int count_pids(const pid_t *pids)
+{
+    int n = 0;
+    while (pids[n])
+        n++;
+    return n;
+}
+
+int main(int argc, char *argv[])
+{
+    int n_procs = argc > 1 ? atoi(argv[1]) : 500;
+    int iterations = argc > 2 ? atoi(argv[2]) : 50;
+
+    pid_t root = fork();
+    if (root < 0) {
+        perror("fork");
+        return 1;
+    }
+    if (!root) {
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        spawn_tree(n_procs);
+    }
+
+    /* wait for the whole forest to show up */
+    pstree_set_backend("sync");
+    int expected = n_procs + 1;
+    for (int i = 0; i < 1000; i++) {
+        g_autofree pid_t *pids = get_pid_children(root);
+        if (pids && count_pids(pids) == expected)
+            break;
+        usleep(10000);
+    }
+
+    printf("%d processes, %d iterations\n", expected, iterations);
+    for (int b = 0; b < G_N_ELEMENTS(backends); b++) {
+        if (!pstree_set_backend(backends[b])) {
+            printf("%-10s unavailable\n", backends[b]);
+            continue;
+        }
+
+        gint64 total = 0, best = G_MAXINT64;
+        for (int i = 0; i < iterations; i++) {
+            gint64 start = g_get_monotonic_time();
+            g_autofree pid_t *pids = get_pid_children(root);
+            gint64 elapsed = g_get_monotonic_time() - start;
+            if (!pids || count_pids(pids) != expected) {
+                fprintf(stderr, "%s: found %d of %d processes\n", backends[b], pids ? count_pids(pids) : 0, expected);
+                break;
+            }
+            total += elapsed;
+            best = MIN(best, elapsed);
+        }
+        printf("%-10s mean %6ld us  min %6ld us\n", backends[b], (long)(total / iterations), (long)best);
+    }
+
+    kill(root, SIGKILL);
+    waitpid(root, NULL, 0);
+    return 0;
+}
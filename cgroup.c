@@ -0,0 +1,80 @@
+#define _GNU_SOURCE
+#include "freezer.h"
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+char *pid_cgroup_dir(pid_t pid)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/cgroup", pid);
+    g_autofree char *buf = NULL;
+    if (!g_file_get_contents(path, &buf, NULL, NULL))
+        return NULL;
+    /* cgroup v2 only: a single "0::/path" line */
+    if (!g_str_has_prefix(buf, "0::"))
+        return NULL;
+    return g_build_filename("/sys/fs/cgroup", g_strstrip(buf + strlen("0::")), NULL);
+}
+
+/*
+ * Units started by systemd-run, flatpak or app launchers: app-<name>.scope,
+ * or any scope directly in app.slice. Anything else (e.g. sway's session
+ * scope) is shared with unrelated processes.
+ */
+static bool is_app_scope(const char *dir)
+{
+    g_autofree char *name = g_path_get_basename(dir);
+    if (!g_str_has_suffix(name, ".scope"))
+        return false;
+    if (g_str_has_prefix(name, "app-"))
+        return true;
+    g_autofree char *parent = g_path_get_dirname(dir);
+    return g_str_has_suffix(parent, "/app.slice");
+}
+
+static bool read_cgroup_procs(const char *dir, GArray *result)
+{
+    g_autofree char *procs_path = g_build_filename(dir, "cgroup.procs", NULL);
+    g_autofree char *procs = NULL;
+    if (!g_file_get_contents(procs_path, &procs, NULL, NULL))
+        return false;
+
+    for (char *x = procs; *x;) {
+        char *endptr = NULL;
+        pid_t p = strtoul(x, &endptr, 10);
+        if (endptr == x)
+            break;
+        g_array_append_val(result, p);
+        x = endptr;
+        while (*x == '\n')
+            ++x;
+    }
+
+    /* scopes normally have no children, but nothing stops an app from creating them */
+    g_autoptr(GDir) d = g_dir_open(dir, 0, NULL);
+    if (!d)
+        return true;
+    const char *name;
+    while ((name = g_dir_read_name(d))) {
+        g_autofree char *sub = g_build_filename(dir, name, NULL);
+        if (g_file_test(sub, G_FILE_TEST_IS_DIR))
+            read_cgroup_procs(sub, result);
+    }
+    return true;
+}
+
+pid_t *get_cgroup_members(pid_t pid)
+{
+    g_autofree char *dir = pid_cgroup_dir(pid);
+    if (!dir || !is_app_scope(dir))
+        return NULL;
+
+    GArray *result = g_array_new(true, false, sizeof(pid_t));
+    if (!read_cgroup_procs(dir, result) || !result->len) {
+        g_array_free(result, true);
+        return NULL;
+    }
+    return (pid_t *)g_array_free(result, false);
+}
@@ -0,0 +1,137 @@
+#define _GNU_SOURCE
+#include "freezer.h"
+#include "ipc-client.h"
+#include <errno.h>
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/*
+ * Line based control socket: a client writes one command per line and gets
+ * the command's output back, ending in "ok" or "error: <reason>". Clients
+ * are served one at a time, with a non-blocking socket polled by the main
+ * loop, so each wakeup handles at most one buffer of commands. A client
+ * that stops talking gives way to the next one after CONTROL_TIMEOUT_MS.
+ */
+
+#define CONTROL_TIMEOUT_MS 1000
+#define CONTROL_MAX_LINE 1024
+
+struct control {
+    int fd;
+    char *path;
+    /* the client being served, -1 if none */
+    int client;
+    gint64 client_active;
+    char buf[CONTROL_MAX_LINE];
+    size_t len;
+};
+
+static char *control_path(void) { return g_build_filename(g_get_user_runtime_dir(), "sway-freezer.sock", NULL); }
+
+struct control *control_open(void)
+{
+    struct control *c = g_new0(struct control, 1);
+    c->path = control_path();
+    c->client = -1;
+
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(c->path) >= sizeof(addr.sun_path))
+        die("%s: path too long", c->path);
+    strcpy(addr.sun_path, c->path);
+
+    c->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (c->fd < 0)
+        die("socket: %m");
+    /* left behind by a crashed instance; a live one holds the journal lock, so we'd not get this far */
+    unlink(c->path);
+    if (bind(c->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+        die("%s: %m", c->path);
+    if (listen(c->fd, 4) < 0)
+        die("listen: %m");
+    return c;
+}
+
+static void drop_client(struct control *c)
+{
+    close(c->client);
+    c->client = -1;
+    c->len = 0;
+}
+
+void control_close(struct control *c)
+{
+    if (c->client >= 0)
+        drop_client(c);
+    close(c->fd);
+    unlink(c->path);
+    g_free(c->path);
+    g_free(c);
+}
+
+int control_fd(struct control *c) { return c->fd; }
+
+int control_client_fd(struct control *c) { return c->client; }
+
+/* replies are short, a client whose socket buffer is full isn't reading them */
+static bool send_reply(int fd, const char *buf, size_t len)
+{
+    return send(fd, buf, len, MSG_NOSIGNAL | MSG_DONTWAIT) == (ssize_t)len;
+}
+
+void control_accept(struct control *c)
+{
+    int fd = accept4(c->fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+    if (fd < 0) {
+        perror("accept");
+        return;
+    }
+    if (c->client >= 0) {
+        if (g_get_monotonic_time() - c->client_active < CONTROL_TIMEOUT_MS * 1000L) {
+            const char *err = "error: busy\n";
+            send_reply(fd, err, strlen(err));
+            close(fd);
+            return;
+        }
+        drop_client(c);
+    }
+    c->client = fd;
+    c->client_active = g_get_monotonic_time();
+}
+
+void control_serve(struct control *c, control_func cb, void *user_data)
+{
+    ssize_t n = recv(c->client, c->buf + c->len, sizeof(c->buf) - 1 - c->len, 0);
+    if (n < 0 && (errno == EAGAIN || errno == EINTR))
+        return;
+    if (n <= 0) {
+        drop_client(c);
+        return;
+    }
+    c->client_active = g_get_monotonic_time();
+    c->len += n;
+    c->buf[c->len] = '\0';
+
+    char *line = c->buf, *nl;
+    while ((nl = strchr(line, '\n'))) {
+        *nl = '\0';
+        g_autoptr(GString) reply = g_string_new(NULL);
+        bool ok = cb(g_strstrip(line), reply, user_data);
+        g_string_append(reply, ok ? "ok\n" : "\n");
+        if (!send_reply(c->client, reply->str, reply->len)) {
+            drop_client(c);
+            return;
+        }
+        line = nl + 1;
+    }
+    c->len -= line - c->buf;
+    memmove(c->buf, line, c->len);
+    if (c->len == sizeof(c->buf) - 1) {
+        const char *err = "error: line too long\n";
+        send_reply(c->client, err, strlen(err));
+        drop_client(c);
+    }
+}
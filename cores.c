@@ -0,0 +1,231 @@
+#define _GNU_SOURCE
+#include "freezer.h"
+#include <dirent.h>
+#include <glib.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Cores at most this fast relative to the fastest are efficiency cores. A
+ * smaller gap is binning, like the preferred cores of Turbo Boost Max 3.0,
+ * not a different core type.
+ */
+#define EFFICIENCY_MAX_PERCENT 80
+
+/* where parked apps run, and the CPUs we were started with */
+static cpu_set_t park_set;
+static cpu_set_t home_set;
+
+/* tid -> cpu_set_t the thread had before it was parked */
+static GHashTable *saved_masks;
+/* saved masks of threads that exited while parked are dropped past this many */
+#define SAVED_MASKS_PRUNE 4096
+
+/* "0-3,8,10-11" */
+static bool parse_cpulist(const char *list, cpu_set_t *set)
+{
+    CPU_ZERO(set);
+    const char *x = list;
+    while (*x && *x != '\n') {
+        char *endptr = NULL;
+        unsigned long first = strtoul(x, &endptr, 10), last = first;
+        if (endptr == x)
+            return false;
+        x = endptr;
+        if (*x == '-') {
+            last = strtoul(x + 1, &endptr, 10);
+            if (endptr == x + 1 || last < first)
+                return false;
+            x = endptr;
+        }
+        for (unsigned long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+            CPU_SET(cpu, set);
+        if (*x == ',')
+            x++;
+        else if (*x && *x != '\n')
+            return false;
+    }
+    return CPU_COUNT(set) > 0;
+}
+
+static char *format_cpulist(const cpu_set_t *set)
+{
+    GString *s = g_string_new(NULL);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, set))
+            continue;
+        int last = cpu;
+        while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, set))
+            last++;
+        g_string_append_printf(s, s->len ? ",%d" : "%d", cpu);
+        if (last > cpu)
+            g_string_append_printf(s, "-%d", last);
+        cpu = last;
+    }
+    return g_string_free(s, false);
+}
+
+static bool read_cpulist(const char *path, cpu_set_t *set)
+{
+    g_autofree char *buf = NULL;
+    if (!g_file_get_contents(path, &buf, NULL, NULL))
+        return false;
+    return parse_cpulist(buf, set);
+}
+
+static long cpu_sysfs_value(int cpu, const char *file)
+{
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/%s", cpu, file);
+    g_autofree char *buf = NULL;
+    if (!g_file_get_contents(path, &buf, NULL, NULL))
+        return -1;
+    return strtol(buf, NULL, 10);
+}
+
+/* CPUs with the lowest value of a per-CPU sysfs file, if it tells core types apart */
+static bool lowest_cpus(const char *file, cpu_set_t *set)
+{
+    long min = -1, max = -1;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &home_set))
+            continue;
+        long v = cpu_sysfs_value(cpu, file);
+        if (v < 0)
+            return false;
+        min = min < 0 ? v : MIN(min, v);
+        max = MAX(max, v);
+    }
+    if (min * 100 > max * EFFICIENCY_MAX_PERCENT)
+        return false;
+
+    CPU_ZERO(set);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &home_set) && cpu_sysfs_value(cpu, file) == min)
+            CPU_SET(cpu, set);
+    }
+    return true;
+}
+
+/*
+ * Intel hybrid parts list their E-cores as a separate PMU, ARM big.LITTLE
+ * exposes a capacity per CPU, and anything else with mixed cores at least
+ * has different maximum frequencies.
+ */
+static const char *detect_efficiency_cores(cpu_set_t *set)
+{
+    if (read_cpulist("/sys/devices/cpu_atom/cpus", set))
+        return "cpu_atom";
+    if (lowest_cpus("cpu_capacity", set))
+        return "cpu_capacity";
+    if (lowest_cpus("cpufreq/cpuinfo_max_freq", set))
+        return "cpuinfo_max_freq";
+    return NULL;
+}
+
+bool park_cores_init(const char *cpulist)
+{
+    if (sched_getaffinity(0, sizeof(home_set), &home_set) < 0)
+        return false;
+
+    const char *source = "option";
+    if (cpulist) {
+        if (!parse_cpulist(cpulist, &park_set))
+            return false;
+    } else if (!(source = detect_efficiency_cores(&park_set))) {
+        /* homogeneous cores: keep unfocused apps to a quarter of them */
+        source = "low-index cores";
+        int n = MAX(CPU_COUNT(&home_set) / 4, 1);
+        CPU_ZERO(&park_set);
+        for (int cpu = 0; cpu < CPU_SETSIZE && n; cpu++) {
+            if (CPU_ISSET(cpu, &home_set)) {
+                CPU_SET(cpu, &park_set);
+                n--;
+            }
+        }
+    }
+
+    CPU_AND(&park_set, &park_set, &home_set);
+    if (!CPU_COUNT(&park_set))
+        return false;
+    g_autofree char *list = format_cpulist(&park_set);
+    g_debug("parking unfocused apps on CPUs %s (%s)", list, source);
+    return true;
+}
+
+static void set_affinity(pid_t tid, const cpu_set_t *set)
+{
+    if (sched_setaffinity(tid, sizeof(*set), set) < 0 && errno != ESRCH)
+        fprintf(stderr, "sched_setaffinity(%d): %s\n", tid, strerror(errno));
+}
+
+static void prune_saved_masks(void)
+{
+    GHashTableIter iter;
+    gpointer key;
+    g_hash_table_iter_init(&iter, saved_masks);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        char path[32];
+        snprintf(path, sizeof(path), "/proc/%d", GPOINTER_TO_INT(key));
+        if (access(path, F_OK) < 0)
+            g_hash_table_iter_remove(&iter);
+    }
+}
+
+/* affinity is per thread, and new threads and children inherit it from their creator */
+static void for_each_thread(const pid_t *pids, void (*func)(pid_t pid, pid_t tid))
+{
+    for (const pid_t *p = pids; *p; p++) {
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/%d/task", *p);
+        g_autoptr(GDir) d = g_dir_open(path, 0, NULL);
+        if (!d)
+            continue;
+        const char *name;
+        while ((name = g_dir_read_name(d)))
+            func(*p, strtoul(name, NULL, 10));
+    }
+}
+
+static void park_thread(pid_t pid, pid_t tid)
+{
+    cpu_set_t mask;
+    if (sched_getaffinity(tid, sizeof(mask), &mask) < 0)
+        return;
+    /* parked already, possibly by an earlier park of the same app: keep what it had before */
+    if (!CPU_EQUAL(&mask, &park_set))
+        g_hash_table_replace(saved_masks, GINT_TO_POINTER(tid), g_memdup2(&mask, sizeof(mask)));
+    set_affinity(tid, &park_set);
+}
+
+/* threads started while parked get their process's mask back, the app's own choice if it made one */
+static void unpark_thread(pid_t pid, pid_t tid)
+{
+    cpu_set_t *mask = g_hash_table_lookup(saved_masks, GINT_TO_POINTER(tid));
+    if (!mask)
+        mask = g_hash_table_lookup(saved_masks, GINT_TO_POINTER(pid));
+    set_affinity(tid, mask ? mask : &home_set);
+}
+
+static void forget_thread(pid_t pid, pid_t tid) { g_hash_table_remove(saved_masks, GINT_TO_POINTER(tid)); }
+
+void park_pids(const pid_t *pids)
+{
+    if (!saved_masks)
+        saved_masks = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+    if (g_hash_table_size(saved_masks) > SAVED_MASKS_PRUNE)
+        prune_saved_masks();
+    for_each_thread(pids, park_thread);
+}
+
+void unpark_pids(const pid_t *pids)
+{
+    if (!saved_masks)
+        return;
+    for_each_thread(pids, unpark_thread);
+    /* the leaders' masks serve as fallback above, so only drop them once every thread is back */
+    for_each_thread(pids, forget_thread);
+}
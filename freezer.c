@@ -1,25 +1,120 @@
 #define _GNU_SOURCE
 #include "freezer.h"
 #include "ipc-client.h"
+#include "probes.h"
 #include <assert.h>
 #include <glib.h>
 #include <jansson.h>
 #include <poll.h>
 #include <signal.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
 #include <sys/timerfd.h>
 #include <unistd.h>
 
 const uint8_t DELAY_S = 2;
+/* how long selective mode watches an app's processes before picking which to stop */
+const int SAMPLE_MS = 1000;
+/* rescans for children forked while a freeze was in flight */
+const int STOP_MAX_ROUNDS = 8;
+
+struct duty_cycle {
+    int thaw_ms;
+    int period_s;
+};
+
+struct frozen_app {
+    pid_t pid;
+    /* processes stopped by the last freeze, zero-terminated */
+    pid_t *pids;
+    /* the rest of the subtree a selective freeze left running, NULL if everything was stopped */
+    pid_t *spared;
+    gint64 frozen_at;
+    bool reclaimed;
+    /* paged out during this freeze, reported on thaw */
+    long reclaimed_kb;
+    /* next duty cycle thaw, and the end of the current one if thawed */
+    gint64 duty_next;
+    gint64 duty_until;
+    uint64_t duty_ticks_start;
+    uint64_t duty_ticks;
+    unsigned duty_windows;
+};
+
+struct thawed_app {
+    uint64_t majflt;
+    bool prefetched;
+};
+
+/* CPU time baseline of an app waiting for selective freeze */
+struct app_sample {
+    pid_t pid;
+    struct proc_sample *samples;
+    gint64 taken_at;
+    /* time spent scanning /proc for this app, the cost of being selective */
+    gint64 scan_us;
+};
 
 struct context {
     int sway_ipc_fd;
-    char **proc_names;
-    int proc_count;
+    /* app ids to freeze, and the ones exempted at runtime */
+    GHashTable *apps;
+    GHashTable *exempt;
+    int delay_s;
+    /* app_id -> struct frozen_app */
     GHashTable *suspended_procs;
+    struct journal *journal;
+    int reclaim_after_s;
+    int reclaim_timerfd;
+    gboolean prefetch;
+    /* app_id -> struct thawed_app, major fault baseline of the last thaw */
+    GHashTable *thawed_procs;
+    /* app_id -> struct duty_cycle */
+    GHashTable *duty_cycles;
+    int duty_timerfd;
+    /* session idle state, either signalled by tick events or all outputs powered off */
+    bool idle_tick;
+    bool idle_dpms;
+    /* apps frozen only because the session went idle */
+    GHashTable *idle_frozen;
+    gboolean cgroup_discovery;
+    /* selective freeze: stop only processes above this CPU percentage or matching a comm pattern */
+    double selective_cpu;
+    char **selective_comm;
+    /* app_id -> struct app_sample */
+    GHashTable *sampling;
+    int sample_timerfd;
+    /* unfocused apps run on efficiency cores, app_id -> window pid of parked apps */
+    gboolean park_cores;
+    /* --park-cpus, NULL to detect efficiency cores */
+    char *park_cpus;
+    GHashTable *parked;
+    char *focused_app;
+    pid_t focused_pid;
+    struct control *control;
+    /* event loop counters */
+    unsigned long events_read;
+    unsigned long batches;
+    unsigned long focus_coalesced;
 };
 
+static void app_sample_free(gpointer data)
+{
+    struct app_sample *sample = data;
+    g_free(sample->samples);
+    g_free(sample);
+}
+
+static void frozen_app_free(gpointer data)
+{
+    struct frozen_app *app = data;
+    g_free(app->pids);
+    g_free(app->spared);
+    g_free(app);
+}
+
 static const char *json_string_or_die(json_t *h, const char *name, bool nullable)
 {
     json_t *ptr = json_object_get(h, name);
@@ -58,7 +153,7 @@ static bool json_bool_or_die(json_t *h, const char *name)
 static int watch_window_events(void)
 {
     int fd = ipc_open_socket();
-    const char *payload = "[\"window\"]";
+    const char *payload = "[\"window\", \"output\", \"tick\"]";
     uint32_t len = strlen(payload);
     char *resp = ipc_single_command(fd, IPC_SUBSCRIBE, payload, &len);
 
@@ -76,15 +171,18 @@ static int watch_window_events(void)
     return fd;
 }
 
-static json_t *read_window_event(int fd)
+static json_t *read_window_event(int fd, uint32_t *type)
 {
     struct ipc_response *resp = ipc_recv_response(fd);
     if (!resp)
         die("failed to read sway ipc response");
+    FREEZER_PROBE(ipc_frame, resp->type, resp->size);
+    *type = resp->type;
     json_error_t error;
     json_t *root = json_loads(resp->payload, 0, &error);
     if (!root)
         die("failed to parse json: %s", error.text);
+    FREEZER_PROBE(json_parsed, resp->type);
     free_ipc_response(resp);
     return root;
 }
@@ -100,93 +198,71 @@ static const char *get_focused_app(json_t *root, pid_t *pid)
 }
 
 struct window_tree_iter {
-    json_t *root;
-    GQueue *queue;
+    char *reply;
+    GArray *windows;
+    guint pos;
 };
 
+static void collect_window(const struct window_info *win, void *user_data)
+{
+    GArray *windows = user_data;
+    g_array_append_vals(windows, win, 1);
+}
+
 static struct window_tree_iter *get_sway_tree_iter(int fd)
 {
     uint32_t len = 0;
     char *resp = ipc_single_command(fd, IPC_GET_TREE, NULL, &len);
 
-    json_error_t error;
-    json_t *root = json_loads(resp, 0, &error);
-    if (!root)
-        die("failed to parse json: %s", error.text);
-
-    free(resp);
-
     struct window_tree_iter *it = calloc(1, sizeof(*it));
     assert(it != NULL);
 
-    it->root = root;
-    it->queue = g_queue_new();
-    g_queue_push_head(it->queue, root);
+    /* window_info strings point into the reply, keep it until the iterator is freed */
+    it->reply = resp;
+    it->windows = g_array_new(false, false, sizeof(struct window_info));
+    sway_tree_walk(resp, len, collect_window, it->windows);
 
     return it;
 }
 
-static json_t *sway_tree_iter_next(struct window_tree_iter *it)
-{
-    json_t *node = g_queue_pop_tail(it->queue);
-    if (!node)
-        return NULL;
-
-    json_t *children = json_object_get(node, "nodes");
-    if (!children || !json_is_array(children))
-        die("invalid json type for 'nodes'");
-    for (int i = 0; i < json_array_size(children); i++)
-        g_queue_push_head(it->queue, json_array_get(children, i));
-
-    return node;
-}
-
 static void sway_tree_iter_free(struct window_tree_iter *it)
 {
-    json_decref(it->root);
-    g_queue_free(it->queue);
+    free(it->reply);
+    g_array_free(it->windows, true);
     free(it);
 }
 
-struct window_info {
-    const char *app_id;
-    pid_t pid;
-    bool focused;
-};
-
+/* app ids are what we freeze by, so views without one (XWayland) are skipped */
 static bool iter_sway_apps(struct window_tree_iter *it, struct window_info *win)
 {
-    while (true) {
-        json_t *node = sway_tree_iter_next(it);
-        if (!node)
-            return false;
-
-        json_t *ptr = json_object_get(node, "app_id");
-        if (!ptr)
-            continue;
-        if (json_is_null(ptr))
+    while (it->pos < it->windows->len) {
+        struct window_info *w = &g_array_index(it->windows, struct window_info, it->pos++);
+        if (!w->app_id)
             continue;
-        if (!json_is_string(ptr))
-            die("invalid type for 'app_id'");
-
-        if (win) {
-            win->app_id = json_string_value(ptr);
-            win->pid = json_int_or_die(node, "pid");
-            win->focused = json_bool_or_die(node, "focused");
-        }
+        if (win)
+            *win = *w;
         return true;
     }
+    return false;
 }
 
-static void start_timer(int timerfd)
+static void start_timer(struct context *ctx, int timerfd)
 {
     struct itimerspec tim = {
-        .it_value = {.tv_sec = DELAY_S},
+        .it_value = {.tv_sec = ctx->delay_s},
     };
     if (timerfd_settime(timerfd, 0, &tim, NULL) < 0)
         die("timerfd_settime failed: %m");
 }
 
+static bool timer_armed(int timerfd)
+{
+    struct itimerspec tim;
+    if (timerfd_gettime(timerfd, &tim) < 0)
+        die("timerfd_gettime failed: %m");
+    return tim.it_value.tv_sec || tim.it_value.tv_nsec;
+}
+
 static void cancel_timer(int timerfd)
 {
     struct itimerspec tim = {0};
@@ -194,13 +270,70 @@ static void cancel_timer(int timerfd)
         die("timerfd_settime failed: %m");
 }
 
-static bool should_suspend(struct context *ctx, const char *app_id)
+/* arms a CLOCK_MONOTONIC timer for an absolute g_get_monotonic_time() deadline, 0 disarms it */
+static void set_timer_deadline(int timerfd, gint64 deadline)
 {
-    for (int i = 0; i < ctx->proc_count; i++) {
-        if (!strcmp(ctx->proc_names[i], app_id))
-            return true;
+    /* a zero it_value disarms the timer, so round expired deadlines up */
+    struct itimerspec tim = {0};
+    if (deadline) {
+        gint64 delay = MAX(deadline - g_get_monotonic_time(), 1);
+        tim.it_value.tv_sec = delay / G_USEC_PER_SEC;
+        tim.it_value.tv_nsec = (delay % G_USEC_PER_SEC) * 1000;
     }
-    return false;
+    if (timerfd_settime(timerfd, 0, &tim, NULL) < 0)
+        die("timerfd_settime failed: %m");
+}
+
+static void arm_reclaim_timer(struct context *ctx)
+{
+    if (!ctx->reclaim_after_s)
+        return;
+
+    gint64 deadline = 0;
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, ctx->suspended_procs);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        struct frozen_app *app = value;
+        if (app->reclaimed || !app->pids)
+            continue;
+        gint64 t = app->frozen_at + (gint64)ctx->reclaim_after_s * G_USEC_PER_SEC;
+        if (!deadline || t < deadline)
+            deadline = t;
+    }
+    set_timer_deadline(ctx->reclaim_timerfd, deadline);
+}
+
+/* duty windows start on multiples of the period, so apps sharing a period wake together */
+static gint64 duty_align(struct duty_cycle *dc, gint64 now)
+{
+    gint64 period = (gint64)dc->period_s * G_USEC_PER_SEC;
+    return (now / period + 1) * period;
+}
+
+static void arm_duty_timer(struct context *ctx)
+{
+    if (!g_hash_table_size(ctx->duty_cycles))
+        return;
+
+    gint64 deadline = 0;
+    GHashTableIter iter;
+    gpointer value;
+    g_hash_table_iter_init(&iter, ctx->suspended_procs);
+    while (g_hash_table_iter_next(&iter, NULL, &value)) {
+        struct frozen_app *app = value;
+        if (!app->duty_next)
+            continue;
+        gint64 t = app->duty_until ? app->duty_until : app->duty_next;
+        if (!deadline || t < deadline)
+            deadline = t;
+    }
+    set_timer_deadline(ctx->duty_timerfd, deadline);
+}
+
+static bool should_suspend(struct context *ctx, const char *app_id)
+{
+    return g_hash_table_contains(ctx->apps, app_id) && !g_hash_table_contains(ctx->exempt, app_id);
 }
 
 static bool is_suspended(struct context *ctx, const char *app_id)
@@ -208,34 +341,338 @@ static bool is_suspended(struct context *ctx, const char *app_id)
     return g_hash_table_contains(ctx->suspended_procs, app_id);
 }
 
-static bool kill_all(pid_t pid, int signum)
+static pid_t *get_app_pids(struct context *ctx, pid_t pid)
 {
-    pid_t *pids = get_pid_children(pid);
-    if (!pids)
-        return false;
-    for (pid_t *p = pids; *p; p++) {
-        if (kill(*p, signum) < 0)
+    if (ctx->cgroup_discovery) {
+        pid_t *pids = get_cgroup_members(pid);
+        if (pids)
+            return pids;
+    }
+    return get_pid_children(pid);
+}
+
+static int count_pids(const pid_t *pids)
+{
+    int n = 0;
+    while (pids[n])
+        n++;
+    return n;
+}
+
+static void kill_pids(const pid_t *pids, int signum)
+{
+    for (const pid_t *p = pids; *p; p++) {
+        if (kill(*p, signum) < 0 && errno != ESRCH)
             perror("kill");
     }
-    return true;
+}
+
+/* pids is a fresh scan of the window's tree, for children forked since the freeze */
+static void resume_app_pids(struct context *ctx, const char *app_id, const pid_t *pids)
+{
+    struct frozen_app *app = g_hash_table_lookup(ctx->suspended_procs, app_id);
+    if (app && app->reclaimed_kb)
+        g_debug("%s had %ld KiB paged out while frozen", app_id, app->reclaimed_kb);
+    if (app && app->duty_windows) {
+        if (app->duty_until) {
+            uint64_t ticks = proc_cpu_ticks(app->pids);
+            app->duty_ticks += ticks > app->duty_ticks_start ? ticks - app->duty_ticks_start : 0;
+        }
+        g_debug("%s was frozen for %ld s, %u duty cycle windows used %ld ms of CPU", app_id,
+                (long)((g_get_monotonic_time() - app->frozen_at) / G_USEC_PER_SEC), app->duty_windows,
+                (long)(app->duty_ticks * 1000 / sysconf(_SC_CLK_TCK)));
+    }
+
+    struct thawed_app *thawed = g_new0(struct thawed_app, 1);
+    thawed->majflt = proc_major_faults(pids);
+    if (ctx->prefetch && is_suspended(ctx, app_id)) {
+        /* still stopped: let swap-in happen before the app touches its memory */
+        thawed->prefetched = prefetch_memory(pids);
+        if (!thawed->prefetched)
+            fprintf(stderr, "can't prefetch memory of %s: needs CAP_SYS_NICE\n", app_id);
+    }
+    g_hash_table_replace(ctx->thawed_procs, strdup(app_id), thawed);
+
+    kill_pids(pids, SIGCONT);
+    /* what was stopped may have left the tree since, e.g. reparented when the window's process exited */
+    if (app && app->pids)
+        kill_pids(app->pids, SIGCONT);
+    FREEZER_PROBE(resume_app, app_id, count_pids(pids));
+    journal_remove(ctx->journal, app_id);
+    g_hash_table_remove(ctx->suspended_procs, app_id);
 }
 
 static bool resume_app(struct context *ctx, const char *app_id, pid_t pid)
 {
-    if (!kill_all(pid, SIGCONT))
+    g_autofree pid_t *pids = get_app_pids(ctx, pid);
+    if (!pids)
         return false;
-    g_hash_table_remove(ctx->suspended_procs, app_id);
+    resume_app_pids(ctx, app_id, pids);
     return true;
 }
 
+struct journal_target {
+    struct journal *journal;
+    const char *app_id;
+    /* the first batch replaces the record, later ones only add to it */
+    bool started;
+};
+
+/* record before stopping, so a crash in between can't leak frozen processes */
+static void journal_pids(const pid_t *pids, void *user_data)
+{
+    struct journal_target *target = user_data;
+    if (target->started)
+        journal_extend(target->journal, target->app_id, pids);
+    else
+        journal_add(target->journal, target->app_id, pids);
+    target->started = true;
+}
+
+/* stops pids along with children forked meanwhile but not in spared, *pids is replaced by everything stopped */
+static void stop_app_pids(struct context *ctx, const char *app_id, pid_t **pids, const pid_t *spared)
+{
+    struct journal_target target = {ctx->journal, app_id, false};
+    gint64 start = g_get_monotonic_time();
+    int n = count_pids(*pids);
+    int rounds = stop_pids(pids, spared, STOP_MAX_ROUNDS, journal_pids, &target);
+    if (rounds < 0)
+        fprintf(stderr, "%s kept forking, some of its processes may not be frozen\n", app_id);
+    else if (count_pids(*pids) > n)
+        g_debug("%s forked %d processes during the freeze, stopped after %d rescans in %ld us", app_id,
+                count_pids(*pids) - n, rounds, (long)(g_get_monotonic_time() - start));
+}
+
+/* stops pids and tracks the app as frozen, taking ownership of pids and spared */
+static void stop_app(struct context *ctx, const char *app_id, pid_t pid, pid_t *pids, pid_t *spared)
+{
+    stop_app_pids(ctx, app_id, &pids, spared);
+    FREEZER_PROBE(suspend_app, app_id, count_pids(pids));
+
+    struct thawed_app *thawed = g_hash_table_lookup(ctx->thawed_procs, app_id);
+    if (thawed) {
+        uint64_t majflt = proc_major_faults(pids);
+        g_debug("%s took %" G_GUINT64_FORMAT " major faults since thaw (prefetch %s)", app_id,
+                majflt > thawed->majflt ? majflt - thawed->majflt : 0, thawed->prefetched ? "on" : "off");
+        g_hash_table_remove(ctx->thawed_procs, app_id);
+    }
+
+    struct frozen_app *app = g_new0(struct frozen_app, 1);
+    app->pid = pid;
+    app->pids = pids;
+    app->spared = spared;
+    app->frozen_at = g_get_monotonic_time();
+    struct duty_cycle *dc = g_hash_table_lookup(ctx->duty_cycles, app_id);
+    if (dc)
+        app->duty_next = duty_align(dc, app->frozen_at);
+    g_hash_table_insert(ctx->suspended_procs, strdup(app_id), app);
+}
+
 static bool suspend_app(struct context *ctx, const char *app_id, pid_t pid)
 {
-    if (!kill_all(pid, SIGSTOP))
+    pid_t *pids = get_app_pids(ctx, pid);
+    if (!pids)
+        return false;
+    stop_app(ctx, app_id, pid, pids, NULL);
+    return true;
+}
+
+static bool is_selective(struct context *ctx) { return ctx->selective_cpu > 0 || ctx->selective_comm; }
+
+static struct proc_sample *sample_app(pid_t pid, gint64 *scan_us)
+{
+    gint64 start = g_get_monotonic_time();
+    struct proc_sample *samples = get_pid_samples(pid);
+    *scan_us += g_get_monotonic_time() - start;
+    return samples;
+}
+
+/* first half of a selective freeze: note the CPU time of every process, selection happens on the sample timer */
+static bool start_sampling(struct context *ctx, const char *app_id, pid_t pid)
+{
+    struct app_sample *sample = g_new0(struct app_sample, 1);
+    sample->pid = pid;
+    sample->samples = sample_app(pid, &sample->scan_us);
+    if (!sample->samples) {
+        app_sample_free(sample);
         return false;
-    g_hash_table_add(ctx->suspended_procs, strdup(app_id));
+    }
+    sample->taken_at = g_get_monotonic_time();
+    g_hash_table_replace(ctx->sampling, strdup(app_id), sample);
+
+    struct itimerspec tim = {
+        .it_value = {.tv_sec = SAMPLE_MS / 1000, .tv_nsec = (SAMPLE_MS % 1000) * 1000000L},
+    };
+    if (timerfd_settime(ctx->sample_timerfd, 0, &tim, NULL) < 0)
+        die("timerfd_settime failed: %m");
     return true;
 }
 
+static bool comm_selected(struct context *ctx, const char *comm)
+{
+    for (char **pattern = ctx->selective_comm; pattern && *pattern; pattern++) {
+        if (g_pattern_match_simple(*pattern, comm))
+            return true;
+    }
+    return false;
+}
+
+/*
+ * Picks the processes to stop from two samples of the subtree. Processes
+ * forked since the baseline count all their CPU time against the interval.
+ * The rest of the subtree goes to *spared. Returns NULL if nothing is worth
+ * stopping.
+ */
+static pid_t *select_pids(struct context *ctx, const char *app_id, struct app_sample *sample, pid_t **spared)
+{
+    struct proc_sample *now = sample_app(sample->pid, &sample->scan_us);
+    if (!now)
+        return NULL;
+    gint64 interval_us = MAX(g_get_monotonic_time() - sample->taken_at, 1);
+    long clk_tck = sysconf(_SC_CLK_TCK);
+
+    g_autoptr(GHashTable) baseline = g_hash_table_new(NULL, NULL);
+    for (struct proc_sample *s = sample->samples; s->pid; s++)
+        g_hash_table_insert(baseline, GUINT_TO_POINTER(s->pid), &s->cpu_ticks);
+
+    GArray *selected = g_array_new(true, false, sizeof(pid_t));
+    GArray *rest = g_array_new(true, false, sizeof(pid_t));
+    uint64_t stopped_ticks = 0, total_ticks = 0;
+    int total = 0;
+    for (struct proc_sample *s = now; s->pid; s++) {
+        uint64_t *before = g_hash_table_lookup(baseline, GUINT_TO_POINTER(s->pid));
+        uint64_t ticks = s->cpu_ticks;
+        if (before)
+            ticks = ticks > *before ? ticks - *before : 0;
+        double cpu = 100.0 * ticks * G_USEC_PER_SEC / clk_tck / interval_us;
+        total++;
+        total_ticks += ticks;
+        if (comm_selected(ctx, s->comm) || (ctx->selective_cpu > 0 && cpu >= ctx->selective_cpu)) {
+            g_array_append_val(selected, s->pid);
+            stopped_ticks += ticks;
+            g_debug("%s: stopping %d (%s) at %.1f%% CPU", app_id, s->pid, s->comm, cpu);
+        } else {
+            g_array_append_val(rest, s->pid);
+        }
+    }
+    g_free(now);
+
+    /* savings are what the stopped processes burned per second, the cost is our own scanning */
+    g_debug("%s: stopping %u of %d processes, saves %ld of %ld ms CPU/s, selection took %ld ms", app_id, selected->len,
+            total, (long)(stopped_ticks * 1000 * G_USEC_PER_SEC / clk_tck / interval_us),
+            (long)(total_ticks * 1000 * G_USEC_PER_SEC / clk_tck / interval_us), (long)(sample->scan_us / 1000));
+
+    if (!selected->len) {
+        g_array_free(selected, true);
+        g_array_free(rest, true);
+        return NULL;
+    }
+    *spared = (pid_t *)g_array_free(rest, false);
+    return (pid_t *)g_array_free(selected, false);
+}
+
+static void suspend_sampled_apps(struct context *ctx)
+{
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, ctx->sampling);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        const char *app_id = key;
+        struct app_sample *sample = value;
+        if (!is_suspended(ctx, app_id)) {
+            pid_t *spared = NULL;
+            pid_t *pids = select_pids(ctx, app_id, sample, &spared);
+            if (pids)
+                stop_app(ctx, app_id, sample->pid, pids, spared);
+        }
+        g_hash_table_iter_remove(&iter);
+    }
+}
+
+static void run_duty_cycles(struct context *ctx)
+{
+    gint64 now = g_get_monotonic_time();
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, ctx->suspended_procs);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        const char *app_id = key;
+        struct frozen_app *app = value;
+        if (!app->duty_next || !app->pid)
+            continue;
+        struct duty_cycle *dc = g_hash_table_lookup(ctx->duty_cycles, app_id);
+
+        if (app->duty_until && now >= app->duty_until) {
+            /*
+             * The app may have forked during the window, stop the whole
+             * subtree again. Selective freezes stick to their choice.
+             */
+            pid_t *pids = app->spared ? NULL : get_app_pids(ctx, app->pid);
+            if (pids) {
+                g_free(app->pids);
+                app->pids = pids;
+            }
+            stop_app_pids(ctx, app_id, &app->pids, app->spared);
+            uint64_t ticks = proc_cpu_ticks(app->pids);
+            app->duty_ticks += ticks > app->duty_ticks_start ? ticks - app->duty_ticks_start : 0;
+            app->duty_until = 0;
+            app->duty_next = duty_align(dc, now);
+            g_debug("duty cycle of %s done, %u windows used %ld ms of CPU", app_id, app->duty_windows,
+                    (long)(app->duty_ticks * 1000 / sysconf(_SC_CLK_TCK)));
+        } else if (!app->duty_until && now >= app->duty_next) {
+            app->duty_ticks_start = proc_cpu_ticks(app->pids);
+            kill_pids(app->pids, SIGCONT);
+            app->duty_until = now + (gint64)dc->thaw_ms * 1000;
+            app->duty_windows++;
+        }
+    }
+    arm_duty_timer(ctx);
+}
+
+static bool parse_duty_cycle(struct context *ctx, const char *spec)
+{
+    /* APP_ID=MS/SECONDS */
+    const char *eq = strrchr(spec, '=');
+    if (!eq || eq == spec)
+        return false;
+    struct duty_cycle dc;
+    char trailing;
+    if (sscanf(eq + 1, "%d/%d%c", &dc.thaw_ms, &dc.period_s, &trailing) != 2)
+        return false;
+    if (dc.thaw_ms <= 0 || dc.period_s <= 0 || dc.thaw_ms >= dc.period_s * 1000)
+        return false;
+    g_hash_table_replace(ctx->duty_cycles, g_strndup(spec, eq - spec), g_memdup2(&dc, sizeof(dc)));
+    return true;
+}
+
+static void reclaim_frozen_apps(struct context *ctx)
+{
+    gint64 now = g_get_monotonic_time();
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, ctx->suspended_procs);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        const char *app_id = key;
+        struct frozen_app *app = value;
+        if (app->reclaimed || !app->pids)
+            continue;
+        if (now < app->frozen_at + (gint64)ctx->reclaim_after_s * G_USEC_PER_SEC)
+            continue;
+
+        /* don't retry apps we can't reclaim from, they'd keep the timer spinning */
+        app->reclaimed = true;
+        /* only what was stopped: a selective freeze leaves the rest of the tree running */
+        long kb = reclaim_memory(app->pids);
+        if (kb < 0) {
+            fprintf(stderr, "can't reclaim memory of %s: needs CAP_SYS_NICE or a dedicated cgroup\n", app_id);
+            continue;
+        }
+        app->reclaimed_kb = kb;
+        g_debug("reclaimed %ld KiB from %s", kb, app_id);
+    }
+    arm_reclaim_timer(ctx);
+}
+
 static void resume_all_apps(struct context *ctx)
 {
     struct window_tree_iter *it = get_sway_tree_iter(ctx->sway_ipc_fd);
@@ -255,7 +692,9 @@ static void suspend_all_apps(struct context *ctx)
     struct window_info win;
     while (iter_sway_apps(it, &win)) {
         if (!win.focused && should_suspend(ctx, win.app_id) && !is_suspended(ctx, win.app_id)) {
-            if (suspend_app(ctx, win.app_id, win.pid)) {
+            if (is_selective(ctx)) {
+                start_sampling(ctx, win.app_id, win.pid);
+            } else if (suspend_app(ctx, win.app_id, win.pid)) {
                 g_debug("suspended %s processes", win.app_id);
             }
         }
@@ -263,41 +702,740 @@ static void suspend_all_apps(struct context *ctx)
     sway_tree_iter_free(it);
 }
 
+/* DPMS state isn't part of output events, so ask for the outputs again */
+static bool outputs_powered_off(int fd)
+{
+    uint32_t len = 0;
+    char *resp = ipc_single_command(fd, IPC_GET_OUTPUTS, NULL, &len);
+
+    json_error_t error;
+    g_autoptr(json_t) root = json_loads(resp, 0, &error);
+    free(resp);
+    if (!root || !json_is_array(root))
+        die("failed to parse json: %s", root ? "not an array" : error.text);
+
+    for (int i = 0; i < json_array_size(root); i++) {
+        json_t *output = json_array_get(root, i);
+        if (!json_bool_or_die(output, "active"))
+            continue;
+        /* "dpms" got renamed to "power" in sway 1.9 */
+        json_t *power = json_object_get(output, "power");
+        if (!power)
+            power = json_object_get(output, "dpms");
+        if (!power || json_is_true(power))
+            return false;
+    }
+    return true;
+}
+
+static const char *get_tick_payload(json_t *root)
+{
+    if (json_bool_or_die(root, "first"))
+        return NULL;
+    return json_string_or_die(root, "payload", false);
+}
+
+static void enter_idle(struct context *ctx, int timerfd)
+{
+    cancel_timer(timerfd);
+    /* everything gets frozen anyway, no point in being selective */
+    cancel_timer(ctx->sample_timerfd);
+    g_hash_table_remove_all(ctx->sampling);
+
+    /* app_id -> window pid, and apps with a window inhibiting idle */
+    g_autoptr(GHashTable) candidates = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+    g_autoptr(GHashTable) inhibiting = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+    struct window_tree_iter *it = get_sway_tree_iter(ctx->sway_ipc_fd);
+    struct window_info win;
+    while (iter_sway_apps(it, &win)) {
+        if (!should_suspend(ctx, win.app_id) || is_suspended(ctx, win.app_id))
+            continue;
+        /* e.g. a video call, which keeps the screen on for a reason; freezing the app would stop it too */
+        if (win.inhibit_idle)
+            g_hash_table_add(inhibiting, strdup(win.app_id));
+        else if (!g_hash_table_contains(candidates, win.app_id))
+            g_hash_table_insert(candidates, strdup(win.app_id), GINT_TO_POINTER(win.pid));
+    }
+    sway_tree_iter_free(it);
+
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, candidates);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        const char *app_id = key;
+        if (g_hash_table_contains(inhibiting, app_id))
+            continue;
+        if (suspend_app(ctx, app_id, GPOINTER_TO_INT(value))) {
+            g_hash_table_add(ctx->idle_frozen, strdup(app_id));
+            g_debug("suspended %s processes on idle", app_id);
+        }
+    }
+    arm_reclaim_timer(ctx);
+    arm_duty_timer(ctx);
+}
+
+static void leave_idle(struct context *ctx, int timerfd)
+{
+    struct window_tree_iter *it = get_sway_tree_iter(ctx->sway_ipc_fd);
+    struct window_info win;
+    while (iter_sway_apps(it, &win)) {
+        if (!g_hash_table_contains(ctx->idle_frozen, win.app_id))
+            continue;
+        if (resume_app(ctx, win.app_id, win.pid))
+            g_debug("resumed %s processes after idle", win.app_id);
+    }
+    sway_tree_iter_free(it);
+    g_hash_table_remove_all(ctx->idle_frozen);
+
+    /* unfocused apps that were running before idle get their grace period again */
+    if (g_hash_table_size(ctx->apps) != g_hash_table_size(ctx->suspended_procs))
+        start_timer(ctx, timerfd);
+}
+
+static void update_idle(struct context *ctx, int timerfd, bool was_idle)
+{
+    bool idle = ctx->idle_tick || ctx->idle_dpms;
+    if (idle && !was_idle)
+        enter_idle(ctx, timerfd);
+    else if (!idle && was_idle)
+        leave_idle(ctx, timerfd);
+}
+
+static bool socket_has_data(int fd)
+{
+    int avail = 0;
+    if (ioctl(fd, FIONREAD, &avail) < 0)
+        die("ioctl(FIONREAD) failed: %m");
+    return avail > 0;
+}
+
+static void park_app(struct context *ctx, const char *app_id, pid_t pid)
+{
+    g_autofree pid_t *pids = get_app_pids(ctx, pid);
+    if (!pids)
+        return;
+    park_pids(pids);
+    g_hash_table_replace(ctx->parked, strdup(app_id), GINT_TO_POINTER(pid));
+    g_debug("parked %s processes", app_id);
+}
+
+static void unpark_app(struct context *ctx, const char *app_id, pid_t pid)
+{
+    g_autofree pid_t *pids = get_app_pids(ctx, pid);
+    if (pids)
+        unpark_pids(pids);
+    g_hash_table_remove(ctx->parked, app_id);
+}
+
+static void unpark_all_apps(struct context *ctx)
+{
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, ctx->parked);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        g_autofree pid_t *pids = get_app_pids(ctx, GPOINTER_TO_INT(value));
+        if (pids)
+            unpark_pids(pids);
+        g_hash_table_iter_remove(&iter);
+    }
+}
+
+/* the app losing focus gets parked right away, no need to wait for the delay timer */
+static void update_parking(struct context *ctx, const char *app_id)
+{
+    if (ctx->focused_app && strcmp(ctx->focused_app, app_id) && should_suspend(ctx, ctx->focused_app) &&
+        !g_hash_table_contains(ctx->parked, ctx->focused_app))
+        park_app(ctx, ctx->focused_app, ctx->focused_pid);
+}
+
+/* tracked whether parking is on or not, so switching it on knows which app is focused */
+static void set_focused_app(struct context *ctx, const char *app_id, pid_t pid)
+{
+    g_free(ctx->focused_app);
+    ctx->focused_app = g_strdup(app_id);
+    ctx->focused_pid = pid;
+}
+
+static void handle_focus(struct context *ctx, int timerfd, const char *app_id, pid_t pid)
+{
+    g_hash_table_remove(ctx->sampling, app_id);
+    if (ctx->park_cores)
+        update_parking(ctx, app_id);
+    set_focused_app(ctx, app_id, pid);
+    bool parked = g_hash_table_remove(ctx->parked, app_id);
+    bool frozen = should_suspend(ctx, app_id) && is_suspended(ctx, app_id);
+    if (parked || frozen) {
+        /* one scan serves both, unparking first so the app wakes up on fast cores */
+        g_autofree pid_t *pids = get_app_pids(ctx, pid);
+        if (pids && parked)
+            unpark_pids(pids);
+        if (pids && frozen) {
+            resume_app_pids(ctx, app_id, pids);
+            g_debug("resumed %s processes", app_id);
+        }
+    }
+    if (should_suspend(ctx, app_id)) {
+        cancel_timer(timerfd);
+    } else if (g_hash_table_size(ctx->apps) != g_hash_table_size(ctx->suspended_procs))
+        start_timer(ctx, timerfd);
+}
+
+struct event_batch {
+    bool outputs_changed;
+    char *focused_app;
+    pid_t focused_pid;
+    unsigned focus_events;
+};
+
+static void handle_sway_event(struct context *ctx, int events_fd, struct event_batch *batch)
+{
+    uint32_t type;
+    g_autoptr(json_t) resp = read_window_event(events_fd, &type);
+    ctx->events_read++;
+
+    if (type == IPC_EVENT_OUTPUT) {
+        batch->outputs_changed = true;
+    } else if (type == IPC_EVENT_TICK) {
+        const char *payload = get_tick_payload(resp);
+        if (payload && !strcmp(payload, "sway-freezer:idle"))
+            ctx->idle_tick = true;
+        else if (payload && !strcmp(payload, "sway-freezer:active"))
+            ctx->idle_tick = false;
+    } else if (type == IPC_EVENT_WINDOW) {
+        pid_t pid = 0;
+        const char *app_id = get_focused_app(resp, &pid);
+        if (app_id) {
+            g_free(batch->focused_app);
+            batch->focused_app = g_strdup(app_id);
+            batch->focused_pid = pid;
+            batch->focus_events++;
+        }
+    }
+}
+
+/*
+ * Drains every event already buffered on the socket and acts once on the
+ * result. Alt-tab storms produce dozens of focus events in a few ms, and only
+ * the last one matters: acting on each would mean a /proc scan per event.
+ */
+static void handle_sway_events(struct context *ctx, int events_fd, int timerfd)
+{
+    bool was_idle = ctx->idle_tick || ctx->idle_dpms;
+    struct event_batch batch = {0};
+
+    do {
+        /* the event's json is gone once handle_sway_event() returns */
+        json_arena_begin();
+        handle_sway_event(ctx, events_fd, &batch);
+        json_arena_end();
+    } while (socket_has_data(events_fd));
+
+    ctx->batches++;
+    if (batch.focus_events > 1) {
+        ctx->focus_coalesced += batch.focus_events - 1;
+        g_debug("coalesced %u focus events (%lu of %lu events total)", batch.focus_events - 1, ctx->focus_coalesced,
+                ctx->events_read);
+    }
+
+    if (batch.outputs_changed)
+        ctx->idle_dpms = outputs_powered_off(ctx->sway_ipc_fd);
+    update_idle(ctx, timerfd, was_idle);
+
+    if (batch.focused_app && !(ctx->idle_tick || ctx->idle_dpms))
+        handle_focus(ctx, timerfd, batch.focused_app, batch.focused_pid);
+    else if (batch.focused_app)
+        set_focused_app(ctx, batch.focused_app, batch.focused_pid);
+    g_free(batch.focused_app);
+}
+
+/* prefers a focused window of the app, returns false if it has none */
+static bool find_app_window(struct context *ctx, const char *app_id, pid_t *pid, bool *focused)
+{
+    bool found = false;
+    struct window_tree_iter *it = get_sway_tree_iter(ctx->sway_ipc_fd);
+    struct window_info win;
+    while (iter_sway_apps(it, &win)) {
+        if (strcmp(win.app_id, app_id) || (found && !win.focused))
+            continue;
+        *pid = win.pid;
+        *focused = win.focused;
+        found = true;
+    }
+    sway_tree_iter_free(it);
+    return found;
+}
+
+/*
+ * Thaws an app even if its window is gone, by continuing what was stopped.
+ * Returns false, leaving the app frozen, if none of its processes are known.
+ */
+static bool thaw_app(struct context *ctx, const char *app_id)
+{
+    struct frozen_app *app = g_hash_table_lookup(ctx->suspended_procs, app_id);
+    pid_t pid = app->pid;
+    bool focused;
+    if (!pid)
+        find_app_window(ctx, app_id, &pid, &focused);
+    if (pid && resume_app(ctx, app_id, pid))
+        return true;
+    if (!app->pids)
+        return false;
+    kill_pids(app->pids, SIGCONT);
+    journal_remove(ctx->journal, app_id);
+    g_hash_table_remove(ctx->suspended_procs, app_id);
+    return true;
+}
+
+/* undoes everything the freezer did to an app, false if it couldn't be thawed */
+static bool release_app(struct context *ctx, const char *app_id)
+{
+    g_hash_table_remove(ctx->sampling, app_id);
+    g_hash_table_remove(ctx->idle_frozen, app_id);
+    if (g_hash_table_contains(ctx->parked, app_id))
+        unpark_app(ctx, app_id, GPOINTER_TO_INT(g_hash_table_lookup(ctx->parked, app_id)));
+    return !is_suspended(ctx, app_id) || thaw_app(ctx, app_id);
+}
+
+/*
+ * An app that became freezable gets the same treatment as one that just lost
+ * focus. It joins a pending freeze rather than restarting the delay timer,
+ * which would postpone the freeze of every other app waiting on it.
+ */
+static void track_app(struct context *ctx, int timerfd, const char *app_id)
+{
+    pid_t pid;
+    bool focused;
+    if (!find_app_window(ctx, app_id, &pid, &focused) || focused)
+        return;
+    if (ctx->park_cores)
+        park_app(ctx, app_id, pid);
+    if (!timer_armed(timerfd))
+        start_timer(ctx, timerfd);
+}
+
+struct control_target {
+    struct context *ctx;
+    int timerfd;
+};
+
+static G_GNUC_PRINTF(2, 3) bool control_error(GString *reply, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    g_string_append(reply, "error: ");
+    g_string_append_vprintf(reply, fmt, args);
+    va_end(args);
+    return false;
+}
+
+static bool parse_number(const char *arg, double min, double max, double *out)
+{
+    char *endptr = NULL;
+    double v = strtod(arg, &endptr);
+    if (endptr == arg || *endptr || v < min || v > max)
+        return false;
+    *out = v;
+    return true;
+}
+
+static bool parse_switch(const char *arg, gboolean *out)
+{
+    if (!strcmp(arg, "on"))
+        *out = true;
+    else if (!strcmp(arg, "off"))
+        *out = false;
+    else
+        return false;
+    return true;
+}
+
+static bool cmd_add(struct control_target *t, const char *app_id, GString *reply)
+{
+    if (!g_hash_table_add(t->ctx->apps, g_strdup(app_id)))
+        return control_error(reply, "%s is already tracked", app_id);
+    track_app(t->ctx, t->timerfd, app_id);
+    return true;
+}
+
+static bool cmd_remove(struct control_target *t, const char *app_id, GString *reply)
+{
+    if (!g_hash_table_contains(t->ctx->apps, app_id))
+        return control_error(reply, "%s is not tracked", app_id);
+    if (!release_app(t->ctx, app_id))
+        return control_error(reply, "can't find processes of %s to thaw", app_id);
+    g_hash_table_remove(t->ctx->exempt, app_id);
+    g_hash_table_remove(t->ctx->apps, app_id);
+    return true;
+}
+
+static bool cmd_freeze(struct control_target *t, const char *app_id, GString *reply)
+{
+    struct context *ctx = t->ctx;
+    if (!should_suspend(ctx, app_id))
+        return control_error(reply, "%s is not tracked or exempt", app_id);
+    if (is_suspended(ctx, app_id))
+        return control_error(reply, "%s is already frozen", app_id);
+    pid_t pid;
+    bool focused;
+    if (!find_app_window(ctx, app_id, &pid, &focused))
+        return control_error(reply, "%s has no window", app_id);
+    g_hash_table_remove(ctx->sampling, app_id);
+    if (!suspend_app(ctx, app_id, pid))
+        return control_error(reply, "can't find processes of %s", app_id);
+    arm_reclaim_timer(ctx);
+    arm_duty_timer(ctx);
+    return true;
+}
+
+static bool cmd_thaw(struct control_target *t, const char *app_id, GString *reply)
+{
+    if (!is_suspended(t->ctx, app_id))
+        return control_error(reply, "%s is not frozen", app_id);
+    if (!thaw_app(t->ctx, app_id))
+        return control_error(reply, "can't find processes of %s to thaw", app_id);
+    g_hash_table_remove(t->ctx->idle_frozen, app_id);
+    return true;
+}
+
+static bool cmd_exempt(struct control_target *t, const char *app_id, GString *reply)
+{
+    if (!g_hash_table_contains(t->ctx->apps, app_id))
+        return control_error(reply, "%s is not tracked", app_id);
+    if (g_hash_table_contains(t->ctx->exempt, app_id))
+        return control_error(reply, "%s is already exempt", app_id);
+    if (!release_app(t->ctx, app_id))
+        return control_error(reply, "can't find processes of %s to thaw", app_id);
+    g_hash_table_add(t->ctx->exempt, g_strdup(app_id));
+    return true;
+}
+
+static bool cmd_unexempt(struct control_target *t, const char *app_id, GString *reply)
+{
+    if (!g_hash_table_remove(t->ctx->exempt, app_id))
+        return control_error(reply, "%s is not exempt", app_id);
+    track_app(t->ctx, t->timerfd, app_id);
+    return true;
+}
+
+static bool cmd_delay(struct control_target *t, const char *arg, GString *reply)
+{
+    double v;
+    if (!parse_number(arg, 1, 3600, &v))
+        return control_error(reply, "expected SECONDS between 1 and 3600");
+    /* a pending freeze keeps its deadline */
+    t->ctx->delay_s = v;
+    return true;
+}
+
+static bool cmd_reclaim_after(struct control_target *t, const char *arg, GString *reply)
+{
+    double v;
+    if (!parse_number(arg, 0, G_MAXINT, &v))
+        return control_error(reply, "expected SECONDS, 0 disables reclaim");
+    t->ctx->reclaim_after_s = v;
+    if (v)
+        arm_reclaim_timer(t->ctx);
+    else
+        set_timer_deadline(t->ctx->reclaim_timerfd, 0);
+    return true;
+}
+
+static bool cmd_prefetch(struct control_target *t, const char *arg, GString *reply)
+{
+    if (!parse_switch(arg, &t->ctx->prefetch))
+        return control_error(reply, "expected on or off");
+    return true;
+}
+
+static bool cmd_duty_cycle(struct control_target *t, const char *arg, GString *reply)
+{
+    struct context *ctx = t->ctx;
+    const char *eq = strrchr(arg, '=');
+    if (!eq || eq == arg)
+        return control_error(reply, "expected APP_ID=MS/SECONDS or APP_ID=off");
+    g_autofree char *app_id = g_strndup(arg, eq - arg);
+    struct frozen_app *app = g_hash_table_lookup(ctx->suspended_procs, app_id);
+
+    if (!strcmp(eq + 1, "off")) {
+        g_hash_table_remove(ctx->duty_cycles, app_id);
+        if (app) {
+            /* cut a running window short, nothing would end it otherwise */
+            if (app->duty_until)
+                stop_app_pids(ctx, app_id, &app->pids, app->spared);
+            app->duty_until = 0;
+            app->duty_next = 0;
+        }
+        return true;
+    }
+
+    if (!parse_duty_cycle(ctx, arg))
+        return control_error(reply, "expected APP_ID=MS/SECONDS or APP_ID=off");
+    if (app && app->pid && !app->duty_next) {
+        app->duty_next = duty_align(g_hash_table_lookup(ctx->duty_cycles, app_id), g_get_monotonic_time());
+        arm_duty_timer(ctx);
+    }
+    return true;
+}
+
+static bool cmd_selective_cpu(struct control_target *t, const char *arg, GString *reply)
+{
+    if (!parse_number(arg, 0, 100, &t->ctx->selective_cpu))
+        return control_error(reply, "expected PERCENT between 0 and 100, 0 disables it");
+    return true;
+}
+
+static bool cmd_park(struct control_target *t, const char *arg, GString *reply)
+{
+    struct context *ctx = t->ctx;
+    gboolean park;
+    if (!parse_switch(arg, &park))
+        return control_error(reply, "expected on or off");
+    if (!park) {
+        unpark_all_apps(ctx);
+        ctx->park_cores = false;
+        return true;
+    }
+    if (ctx->park_cores)
+        return true;
+    if (!park_cores_init(ctx->park_cpus))
+        return control_error(reply, "no CPUs to park apps on");
+    ctx->park_cores = true;
+
+    struct window_tree_iter *it = get_sway_tree_iter(ctx->sway_ipc_fd);
+    struct window_info win;
+    while (iter_sway_apps(it, &win)) {
+        if (!win.focused && should_suspend(ctx, win.app_id) && !g_hash_table_contains(ctx->parked, win.app_id) &&
+            g_strcmp0(win.app_id, ctx->focused_app))
+            park_app(ctx, win.app_id, win.pid);
+    }
+    sway_tree_iter_free(it);
+    return true;
+}
+
+static bool cmd_status(struct control_target *t, const char *arg, GString *reply)
+{
+    struct context *ctx = t->ctx;
+    GHashTableIter iter;
+    gpointer key;
+    g_hash_table_iter_init(&iter, ctx->apps);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        const char *app_id = key;
+        struct frozen_app *app = g_hash_table_lookup(ctx->suspended_procs, app_id);
+        g_string_append(reply, app_id);
+        if (g_hash_table_contains(ctx->exempt, app_id))
+            g_string_append(reply, " exempt");
+        if (app)
+            g_string_append_printf(reply, " frozen %d%s", app->pids ? count_pids(app->pids) : 0,
+                                   app->spared ? " selective" : "");
+        if (app && app->reclaimed_kb)
+            g_string_append_printf(reply, " reclaimed %ldKiB", app->reclaimed_kb);
+        if (g_hash_table_contains(ctx->sampling, app_id))
+            g_string_append(reply, " sampling");
+        if (g_hash_table_contains(ctx->parked, app_id))
+            g_string_append(reply, " parked");
+        g_string_append_c(reply, '\n');
+    }
+    g_string_append_printf(reply, "delay %d reclaim-after %d prefetch %s selective-cpu %g park %s\n", ctx->delay_s,
+                           ctx->reclaim_after_s, ctx->prefetch ? "on" : "off", ctx->selective_cpu,
+                           ctx->park_cores ? "on" : "off");
+    return true;
+}
+
+static const struct control_command {
+    const char *name;
+    /* NULL if the command takes no argument */
+    const char *arg;
+    bool (*func)(struct control_target *t, const char *arg, GString *reply);
+} control_commands[] = {
+    {"add", "APP_ID", cmd_add},
+    {"remove", "APP_ID", cmd_remove},
+    {"freeze", "APP_ID", cmd_freeze},
+    {"thaw", "APP_ID", cmd_thaw},
+    {"exempt", "APP_ID", cmd_exempt},
+    {"unexempt", "APP_ID", cmd_unexempt},
+    {"delay", "SECONDS", cmd_delay},
+    {"reclaim-after", "SECONDS", cmd_reclaim_after},
+    {"prefetch", "on|off", cmd_prefetch},
+    {"duty-cycle", "APP_ID=MS/SECONDS|APP_ID=off", cmd_duty_cycle},
+    {"selective-cpu", "PERCENT", cmd_selective_cpu},
+    {"park", "on|off", cmd_park},
+    {"status", NULL, cmd_status},
+};
+
+static bool handle_control(char *line, GString *reply, void *user_data)
+{
+    char *arg = strpbrk(line, " \t");
+    if (arg) {
+        *arg++ = '\0';
+        arg = g_strstrip(arg);
+    }
+    for (int i = 0; i < G_N_ELEMENTS(control_commands); i++) {
+        const struct control_command *cmd = &control_commands[i];
+        if (strcmp(line, cmd->name))
+            continue;
+        if (!cmd->arg != !(arg && *arg))
+            return control_error(reply, cmd->arg ? "usage: %s %s" : "usage: %s", cmd->name, cmd->arg);
+        g_debug("control: %s %s", line, arg ? arg : "");
+        return cmd->func(user_data, arg, reply);
+    }
+    return control_error(reply, "unknown command '%s'", line);
+}
+
 static void atexit_handler(int x, void *user_data)
 {
     struct context *ctx = user_data;
+    control_close(ctx->control);
+    unpark_all_apps(ctx);
     resume_all_apps(ctx);
 }
 
 static void signal_handler(int signum) { exit(0); }
 
+static bool adopt_frozen_app(const char *app_id, const pid_t *pids, void *user_data)
+{
+    struct context *ctx = user_data;
+    if (!should_suspend(ctx, app_id))
+        return false;
+    /* window pid and freeze time are unknown until we see the sway tree */
+    struct frozen_app *app = g_new0(struct frozen_app, 1);
+    app->pids = g_memdup2(pids, (count_pids(pids) + 1) * sizeof(pid_t));
+    g_hash_table_insert(ctx->suspended_procs, strdup(app_id), app);
+    return true;
+}
+
+/* adopted apps without a window can't be focused, so nothing would ever thaw them */
+static void thaw_windowless_apps(struct context *ctx)
+{
+    GHashTableIter iter;
+    gpointer key, value;
+    g_hash_table_iter_init(&iter, ctx->suspended_procs);
+    while (g_hash_table_iter_next(&iter, &key, &value)) {
+        struct frozen_app *app = value;
+        if (app->pid)
+            continue;
+        kill_pids(app->pids, SIGCONT);
+        journal_remove(ctx->journal, key);
+        g_debug("thawed adopted %s, it has no window", (const char *)key);
+        g_hash_table_iter_remove(&iter);
+    }
+}
+
 int main(int argc, char *argv[])
 {
+    struct context ctx = {0};
+    g_auto(GStrv) duty_specs = NULL;
+    g_autofree char *scan_backend = NULL;
+
+    GOptionEntry entries[] = {
+        {"reclaim-after", 0, 0, G_OPTION_ARG_INT, &ctx.reclaim_after_s,
+         "Page out memory of apps frozen for longer than SECONDS", "SECONDS"},
+        {"prefetch", 0, 0, G_OPTION_ARG_NONE, &ctx.prefetch, "Swap in memory of apps before thawing them", NULL},
+        {"cgroup-discovery", 0, 0, G_OPTION_ARG_NONE, &ctx.cgroup_discovery,
+         "Find app processes through their systemd or flatpak scope", NULL},
+        {"scan-backend", 0, 0, G_OPTION_ARG_STRING, &scan_backend,
+         "How to scan /proc: io_uring, threads or sync (default: probe)", "BACKEND"},
+        {"duty-cycle", 0, 0, G_OPTION_ARG_STRING_ARRAY, &duty_specs,
+         "Thaw a frozen app for MS milliseconds every SECONDS seconds", "APP_ID=MS/SECONDS"},
+        {"selective-cpu", 0, 0, G_OPTION_ARG_DOUBLE, &ctx.selective_cpu,
+         "Only stop processes of an app using at least PERCENT CPU", "PERCENT"},
+        {"selective-comm", 0, 0, G_OPTION_ARG_STRING_ARRAY, &ctx.selective_comm,
+         "Only stop processes of an app whose name matches PATTERN", "PATTERN"},
+        {"park-cores", 0, 0, G_OPTION_ARG_NONE, &ctx.park_cores, "Run unfocused apps on efficiency cores", NULL},
+        {"park-cpus", 0, 0, G_OPTION_ARG_STRING, &ctx.park_cpus,
+         "Run unfocused apps on these CPUs instead of detected efficiency cores", "LIST"},
+        G_OPTION_ENTRY_NULL,
+    };
+    g_autoptr(GOptionContext) opts = g_option_context_new("<app_id> [<app_id> ...]");
+    g_option_context_add_main_entries(opts, entries, NULL);
+    g_autoptr(GError) error = NULL;
+    if (!g_option_context_parse(opts, &argc, &argv, &error))
+        die("%s", error->message);
+
     if (argc <= 1) {
-        fprintf(stderr, "usage: sway-freezer <app_id> [<app_id> ...]\n");
+        fprintf(stderr, "usage: sway-freezer [OPTION...] <app_id> [<app_id> ...]\n");
         return 1;
     }
 
-    struct context ctx = {0};
-    ctx.proc_names = &argv[1];
-    ctx.proc_count = argc - 1;
-    ctx.suspended_procs = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+    if (!pstree_set_backend(scan_backend))
+        die("%s /proc scan backend is unavailable", scan_backend ? scan_backend : "every");
+    if (ctx.park_cpus)
+        ctx.park_cores = true;
+    if (ctx.park_cores && !park_cores_init(ctx.park_cpus))
+        die("can't park apps on CPUs %s", ctx.park_cpus ? ctx.park_cpus : "(none usable)");
+
+    json_arena_init();
+    ctx.delay_s = DELAY_S;
+    ctx.apps = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    for (int i = 1; i < argc; i++)
+        g_hash_table_add(ctx.apps, g_strdup(argv[i]));
+    ctx.exempt = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+    ctx.suspended_procs = g_hash_table_new_full(g_str_hash, g_str_equal, free, frozen_app_free);
+    ctx.thawed_procs = g_hash_table_new_full(g_str_hash, g_str_equal, free, g_free);
+    ctx.duty_cycles = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+    ctx.idle_frozen = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+    ctx.sampling = g_hash_table_new_full(g_str_hash, g_str_equal, free, app_sample_free);
+    ctx.parked = g_hash_table_new_full(g_str_hash, g_str_equal, free, NULL);
+    if (ctx.selective_cpu < 0 || ctx.selective_cpu > 100)
+        die("invalid CPU percentage %g", ctx.selective_cpu);
+    for (char **spec = duty_specs; spec && *spec; spec++) {
+        if (!parse_duty_cycle(&ctx, *spec))
+            die("invalid duty cycle '%s', expected APP_ID=MS/SECONDS", *spec);
+    }
+
+    /* a previous instance may have died without thawing its apps */
+    ctx.journal = journal_open();
+    journal_recover(ctx.journal, adopt_frozen_app, &ctx);
 
     int timerfd = timerfd_create(CLOCK_REALTIME, 0);
     if (timerfd < 0)
         die("timerfd_create failed: %m");
+    ctx.reclaim_timerfd = timerfd_create(CLOCK_MONOTONIC, 0);
+    if (ctx.reclaim_timerfd < 0)
+        die("timerfd_create failed: %m");
+    ctx.duty_timerfd = timerfd_create(CLOCK_MONOTONIC, 0);
+    if (ctx.duty_timerfd < 0)
+        die("timerfd_create failed: %m");
+    ctx.sample_timerfd = timerfd_create(CLOCK_MONOTONIC, 0);
+    if (ctx.sample_timerfd < 0)
+        die("timerfd_create failed: %m");
 
     ctx.sway_ipc_fd = ipc_open_socket();
+    /* after the journal: its lock keeps a second instance from taking over our socket */
+    ctx.control = control_open();
+    struct control_target control_target = {&ctx, timerfd};
 
     struct window_tree_iter *it = get_sway_tree_iter(ctx.sway_ipc_fd);
     struct window_info win;
     while (iter_sway_apps(it, &win)) {
-        if (should_suspend(&ctx, win.app_id)) {
-            start_timer(timerfd);
-            break;
+        if (win.focused) {
+            ctx.focused_app = g_strdup(win.app_id);
+            ctx.focused_pid = win.pid;
         }
+        if (!should_suspend(&ctx, win.app_id))
+            continue;
+        if (ctx.park_cores && !win.focused)
+            park_app(&ctx, win.app_id, win.pid);
+        struct frozen_app *app = g_hash_table_lookup(ctx.suspended_procs, win.app_id);
+        if (app && win.focused) {
+            if (resume_app(&ctx, win.app_id, win.pid))
+                g_debug("resumed adopted %s processes", win.app_id);
+        } else if (app) {
+            /* the journaled pids are what's actually stopped */
+            app->pid = win.pid;
+            app->frozen_at = g_get_monotonic_time();
+            struct duty_cycle *dc = g_hash_table_lookup(ctx.duty_cycles, win.app_id);
+            if (dc)
+                app->duty_next = duty_align(dc, app->frozen_at);
+        }
+        start_timer(&ctx, timerfd);
     }
     sway_tree_iter_free(it);
+    thaw_windowless_apps(&ctx);
+    /* another window of the focused app may have come first */
+    if (ctx.focused_app && g_hash_table_contains(ctx.parked, ctx.focused_app))
+        unpark_app(&ctx, ctx.focused_app, ctx.focused_pid);
+    arm_reclaim_timer(&ctx);
+    arm_duty_timer(&ctx);
 
     if (on_exit(atexit_handler, &ctx))
         die("on_exit");
@@ -312,6 +1450,11 @@ int main(int argc, char *argv[])
         struct pollfd fds[] = {
             {.fd = events_fd, .events = POLLIN},
             {.fd = timerfd, .events = POLLIN},
+            {.fd = ctx.reclaim_timerfd, .events = POLLIN},
+            {.fd = ctx.duty_timerfd, .events = POLLIN},
+            {.fd = ctx.sample_timerfd, .events = POLLIN},
+            {.fd = control_fd(ctx.control), .events = POLLIN},
+            {.fd = control_client_fd(ctx.control), .events = POLLIN},
         };
 
         if (poll(fds, sizeof(fds) / sizeof(fds[0]), -1) < 0) {
@@ -320,31 +1463,62 @@ int main(int argc, char *argv[])
             continue;
         }
 
-        if (fds[0].revents) {
-            g_autoptr(json_t) resp = read_window_event(events_fd);
-            pid_t pid = 0;
-            const char *app_id = get_focused_app(resp, &pid);
-            if (app_id) {
-                if (should_suspend(&ctx, app_id)) {
-                    cancel_timer(timerfd);
-                    if (is_suspended(&ctx, app_id)) {
-                        if (resume_app(&ctx, app_id, pid)) {
-                            g_debug("resumed %s processes", app_id);
-                        }
-                    }
-                } else if (ctx.proc_count != g_hash_table_size(ctx.suspended_procs))
-                    start_timer(timerfd);
-            }
-        }
+        if (fds[0].revents)
+            handle_sway_events(&ctx, events_fd, timerfd);
 
         if (fds[1].revents) {
             uint64_t val;
             if (read(timerfd, &val, sizeof(val)) < 0)
                 die("timerfd: read failed: %m");
+            FREEZER_PROBE(timer_fire, "delay");
             suspend_all_apps(&ctx);
+            arm_reclaim_timer(&ctx);
+            arm_duty_timer(&ctx);
         }
+
+        if (fds[2].revents) {
+            uint64_t val;
+            if (read(ctx.reclaim_timerfd, &val, sizeof(val)) < 0)
+                die("timerfd: read failed: %m");
+            FREEZER_PROBE(timer_fire, "reclaim");
+            reclaim_frozen_apps(&ctx);
+        }
+
+        if (fds[3].revents) {
+            uint64_t val;
+            if (read(ctx.duty_timerfd, &val, sizeof(val)) < 0)
+                die("timerfd: read failed: %m");
+            FREEZER_PROBE(timer_fire, "duty");
+            run_duty_cycles(&ctx);
+        }
+
+        if (fds[4].revents) {
+            uint64_t val;
+            if (read(ctx.sample_timerfd, &val, sizeof(val)) < 0)
+                die("timerfd: read failed: %m");
+            FREEZER_PROBE(timer_fire, "sample");
+            suspend_sampled_apps(&ctx);
+            arm_reclaim_timer(&ctx);
+            arm_duty_timer(&ctx);
+        }
+
+        if (fds[5].revents)
+            control_accept(ctx.control);
+
+        if (fds[6].revents)
+            control_serve(ctx.control, handle_control, &control_target);
     }
 
+    journal_close(ctx.journal);
+    g_free(ctx.focused_app);
+    g_free(ctx.park_cpus);
+    g_hash_table_unref(ctx.exempt);
+    g_hash_table_unref(ctx.apps);
+    g_hash_table_unref(ctx.parked);
+    g_hash_table_unref(ctx.sampling);
+    g_hash_table_unref(ctx.idle_frozen);
+    g_hash_table_unref(ctx.duty_cycles);
+    g_hash_table_unref(ctx.thawed_procs);
     g_hash_table_unref(ctx.suspended_procs);
 
     return 0;
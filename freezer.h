@@ -2,9 +2,108 @@
 
 #include <glib.h>
 #include <jansson.h>
+#include <unistd.h>
 
 #define CLEANUP(func) __attribute__((cleanup(func)))
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(json_t, json_decref)
 
+static inline void close_fd(int *fd)
+{
+    if (fd && *fd >= 0)
+        close(*fd);
+}
+
+/* Routes jansson allocations between begin and end to an arena, all json_t from it must be gone by end */
+void json_arena_init(void);
+void json_arena_begin(void);
+void json_arena_end(void);
+
+struct window_info {
+    const char *app_id;
+    const char *class;
+    const char *workspace;
+    pid_t pid;
+    bool focused;
+    bool inhibit_idle;
+};
+
+typedef void (*sway_window_func)(const struct window_info *win, void *user_data);
+
+/* Calls cb for every view in a NUL-terminated GET_TREE reply, decoding strings in place; app_id may be NULL */
+void sway_tree_walk(char *buf, size_t len, sway_window_func cb, void *user_data);
+
 pid_t *get_pid_children(pid_t pid);
+
+struct proc_sample {
+    pid_t pid;
+    /* utime + stime, in clock ticks */
+    uint64_t cpu_ticks;
+    char comm[16];
+};
+
+/* Like get_pid_children(), with CPU time and name of each process; a zero pid terminates the array */
+struct proc_sample *get_pid_samples(pid_t pid);
+
+typedef void (*pids_func)(const pid_t *pids, void *user_data);
+
+/*
+ * Sends SIGSTOP to pids, then rescans them for children forked before the
+ * signal landed and stops those too, until a rescan finds nothing new or
+ * max_rounds rescans were done. Children listed in known (may be NULL) were
+ * left running on purpose and aren't newcomers, neither are processes of
+ * other users. *pids is replaced by everything stopped; before_stop sees
+ * each batch of pids ahead of its signals. Returns the number of rescans,
+ * or -1 if the last one still found new children.
+ */
+int stop_pids(pid_t **pids, const pid_t *known, int max_rounds, pids_func before_stop, void *user_data);
+/* Picks the /proc scan backend by name, or the first one that works if name is NULL */
+bool pstree_set_backend(const char *name);
+const char *pstree_backend_name(void);
+/* Members of the app's systemd/flatpak scope, NULL if pid isn't in one */
+pid_t *get_cgroup_members(pid_t pid);
+char *pid_cgroup_dir(pid_t pid);
+
+uint64_t proc_start_time(pid_t pid);
+uint64_t proc_major_faults(const pid_t *pids);
+/* utime + stime of all pids, in clock ticks */
+uint64_t proc_cpu_ticks(const pid_t *pids);
+
+/* Pages out anonymous memory of stopped processes, returns KiB freed or -1 if unsupported */
+long reclaim_memory(const pid_t *pids);
+/* Starts swapping in anonymous memory, so a thawed app doesn't stall on page faults; false if unsupported */
+bool prefetch_memory(const pid_t *pids);
+
+/* Picks the CPUs unfocused apps are parked on: cpulist, or efficiency cores found in sysfs if NULL */
+bool park_cores_init(const char *cpulist);
+/* Remembers the affinity of every thread of pids, then confines them to the parking CPUs */
+void park_pids(const pid_t *pids);
+/* Gives threads back the affinity they had before parking */
+void unpark_pids(const pid_t *pids);
+
+struct control;
+/* Fills reply with the output of a command line; on failure the reply ends with the error */
+typedef bool (*control_func)(char *line, GString *reply, void *user_data);
+
+/* Listens on $XDG_RUNTIME_DIR/sway-freezer.sock */
+struct control *control_open(void);
+void control_close(struct control *c);
+int control_fd(struct control *c);
+/* The connected client's non-blocking socket, -1 if there is none */
+int control_client_fd(struct control *c);
+/* Takes a new client once the current one is gone or idle */
+void control_accept(struct control *c);
+/* Runs the commands the client has sent so far through cb, without waiting for more */
+void control_serve(struct control *c, control_func cb, void *user_data);
+
+struct journal;
+/* pids are the recorded processes still alive; returning false thaws them */
+typedef bool (*journal_adopt_func)(const char *app_id, const pid_t *pids, void *user_data);
+
+struct journal *journal_open(void);
+void journal_close(struct journal *j);
+void journal_recover(struct journal *j, journal_adopt_func adopt, void *user_data);
+void journal_add(struct journal *j, const char *app_id, const pid_t *pids);
+/* Adds pids to the app's record, which journal_add() started */
+void journal_extend(struct journal *j, const char *app_id, const pid_t *pids);
+void journal_remove(struct journal *j, const char *app_id);
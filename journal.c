@@ -0,0 +1,215 @@
+#define _GNU_SOURCE
+#include "freezer.h"
+#include "ipc-client.h"
+#include <assert.h>
+#include <fcntl.h>
+#include <glib.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/*
+ * Fixed-layout state file shared with future instances of the daemon. Every
+ * frozen app owns one record slot; a slot with an empty app_id is free. A
+ * record's seq is odd while it's being rewritten, so a reader can tell a torn
+ * record (daemon killed mid-update) from a complete one.
+ */
+
+#define JOURNAL_MAGIC 0x7a72665fu
+#define JOURNAL_VERSION 1
+#define JOURNAL_MAX_APPS 32
+#define JOURNAL_MAX_PIDS 1024
+#define JOURNAL_APP_ID_LEN 128
+
+struct journal_pid {
+    pid_t pid;
+    uint64_t start_time;
+};
+
+struct journal_record {
+    _Atomic uint32_t seq;
+    uint32_t npids;
+    char app_id[JOURNAL_APP_ID_LEN];
+    struct journal_pid pids[JOURNAL_MAX_PIDS];
+};
+
+struct journal_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nrecords;
+    uint32_t reserved;
+    struct journal_record records[JOURNAL_MAX_APPS];
+};
+
+struct journal {
+    int fd;
+    struct journal_header *hdr;
+};
+
+static char *journal_path(void) { return g_build_filename(g_get_user_runtime_dir(), "sway-freezer.state", NULL); }
+
+static void record_begin(struct journal_record *rec)
+{
+    atomic_fetch_add_explicit(&rec->seq, 1, memory_order_acq_rel);
+    assert(atomic_load_explicit(&rec->seq, memory_order_relaxed) & 1);
+}
+
+static void record_end(struct journal_record *rec) { atomic_fetch_add_explicit(&rec->seq, 1, memory_order_release); }
+
+static struct journal_record *find_record(struct journal *j, const char *app_id)
+{
+    for (int i = 0; i < JOURNAL_MAX_APPS; i++) {
+        struct journal_record *rec = &j->hdr->records[i];
+        if (!strncmp(rec->app_id, app_id, sizeof(rec->app_id)))
+            return rec;
+    }
+    return NULL;
+}
+
+struct journal *journal_open(void)
+{
+    g_autofree char *path = journal_path();
+
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0)
+        die("%s: %m", path);
+    if (flock(fd, LOCK_EX | LOCK_NB) < 0)
+        die("%s is locked, is another sway-freezer running?", path);
+    if (ftruncate(fd, sizeof(struct journal_header)) < 0)
+        die("ftruncate %s: %m", path);
+
+    struct journal_header *hdr =
+        mmap(NULL, sizeof(struct journal_header), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (hdr == MAP_FAILED)
+        die("mmap %s: %m", path);
+
+    if (hdr->magic != JOURNAL_MAGIC || hdr->version != JOURNAL_VERSION || hdr->nrecords != JOURNAL_MAX_APPS) {
+        if (hdr->magic)
+            fprintf(stderr, "%s: unknown journal format, discarding\n", path);
+        memset(hdr, 0, sizeof(*hdr));
+        hdr->magic = JOURNAL_MAGIC;
+        hdr->version = JOURNAL_VERSION;
+        hdr->nrecords = JOURNAL_MAX_APPS;
+    }
+
+    struct journal *j = calloc(1, sizeof(*j));
+    assert(j != NULL);
+    j->fd = fd;
+    j->hdr = hdr;
+    return j;
+}
+
+void journal_close(struct journal *j)
+{
+    munmap(j->hdr, sizeof(*j->hdr));
+    close(j->fd);
+    free(j);
+}
+
+/* recorded processes that are still around, zero-terminated */
+static pid_t *record_live_pids(struct journal_record *rec)
+{
+    GArray *pids = g_array_new(true, false, sizeof(pid_t));
+    uint32_t npids = MIN(rec->npids, JOURNAL_MAX_PIDS);
+    for (uint32_t i = 0; i < npids; i++) {
+        struct journal_pid *p = &rec->pids[i];
+        /* the pid may have been recycled since we froze it */
+        if (p->pid <= 0 || proc_start_time(p->pid) != p->start_time)
+            continue;
+        g_array_append_val(pids, p->pid);
+    }
+    return (pid_t *)g_array_free(pids, false);
+}
+
+static void thaw_pids(const pid_t *pids)
+{
+    for (const pid_t *p = pids; *p; p++) {
+        if (kill(*p, SIGCONT) < 0)
+            perror("kill");
+    }
+}
+
+void journal_recover(struct journal *j, journal_adopt_func adopt, void *user_data)
+{
+    for (int i = 0; i < JOURNAL_MAX_APPS; i++) {
+        struct journal_record *rec = &j->hdr->records[i];
+        if (!rec->app_id[0])
+            continue;
+
+        rec->app_id[sizeof(rec->app_id) - 1] = '\0';
+        bool torn = atomic_load_explicit(&rec->seq, memory_order_acquire) & 1;
+        g_autofree pid_t *pids = record_live_pids(rec);
+
+        if (!torn && *pids && adopt && adopt(rec->app_id, pids, user_data)) {
+            g_debug("adopted frozen %s from previous run", rec->app_id);
+            continue;
+        }
+
+        thaw_pids(pids);
+        g_debug("thawed %s left frozen by previous run", rec->app_id);
+        record_begin(rec);
+        memset(rec->app_id, 0, sizeof(rec->app_id));
+        rec->npids = 0;
+        record_end(rec);
+    }
+}
+
+/* caller has the record open for writing */
+static void record_append(struct journal_record *rec, const pid_t *pids)
+{
+    uint32_t n = rec->npids;
+    const pid_t *p = pids;
+    for (; *p && n < JOURNAL_MAX_PIDS; p++) {
+        rec->pids[n].pid = *p;
+        rec->pids[n].start_time = proc_start_time(*p);
+        n++;
+    }
+    if (*p)
+        fprintf(stderr, "journal: too many processes in %s, recording first %d\n", rec->app_id, JOURNAL_MAX_PIDS);
+    rec->npids = n;
+}
+
+void journal_add(struct journal *j, const char *app_id, const pid_t *pids)
+{
+    struct journal_record *rec = find_record(j, app_id);
+    if (!rec)
+        rec = find_record(j, "");
+    if (!rec) {
+        fprintf(stderr, "journal full, %s won't be recoverable\n", app_id);
+        return;
+    }
+
+    record_begin(rec);
+    g_strlcpy(rec->app_id, app_id, sizeof(rec->app_id));
+    rec->npids = 0;
+    record_append(rec, pids);
+    record_end(rec);
+}
+
+void journal_extend(struct journal *j, const char *app_id, const pid_t *pids)
+{
+    struct journal_record *rec = find_record(j, app_id);
+    if (!rec) {
+        journal_add(j, app_id, pids);
+        return;
+    }
+    record_begin(rec);
+    record_append(rec, pids);
+    record_end(rec);
+}
+
+void journal_remove(struct journal *j, const char *app_id)
+{
+    struct journal_record *rec = find_record(j, app_id);
+    if (!rec)
+        return;
+    record_begin(rec);
+    memset(rec->app_id, 0, sizeof(rec->app_id));
+    rec->npids = 0;
+    record_end(rec);
+}
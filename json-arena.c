@@ -0,0 +1,37 @@
+#include "arena.h"
+#include "freezer.h"
+#include <jansson.h>
+#include <stdlib.h>
+
+/*
+ * jansson allocator for the event loop: while an event is being handled, json
+ * nodes and strings come from an arena that is rewound afterwards instead of
+ * being freed one by one. Outside of that, allocations go to malloc as usual.
+ */
+
+static Arena json_arena;
+static bool json_arena_active;
+
+static void *json_arena_malloc(size_t size)
+{
+    if (json_arena_active)
+        return arena_alloc(&json_arena, size);
+    return malloc(size);
+}
+
+static void json_arena_free(void *ptr)
+{
+    /* arena memory is released all at once by json_arena_end() */
+    if (ptr && !arena_owns(&json_arena, ptr))
+        free(ptr);
+}
+
+void json_arena_init(void) { json_set_alloc_funcs(json_arena_malloc, json_arena_free); }
+
+void json_arena_begin(void) { json_arena_active = true; }
+
+void json_arena_end(void)
+{
+    json_arena_active = false;
+    arena_reset_fit(&json_arena);
+}
@@ -0,0 +1,171 @@
+#define _GNU_SOURCE
+#include "freezer.h"
+#include <fcntl.h>
+#include <glib.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/pidfd.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#ifndef MADV_PAGEOUT
+#define MADV_PAGEOUT 21
+#endif
+
+static long status_field_kb(pid_t pid, const char *field)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/status", pid);
+    g_autofree char *buf = NULL;
+    if (!g_file_get_contents(path, &buf, NULL, NULL))
+        return 0;
+    char *x = strstr(buf, field);
+    if (!x)
+        return 0;
+    return strtol(x + strlen(field), NULL, 10);
+}
+
+static long rss_anon_kb(const pid_t *pids)
+{
+    long total = 0;
+    for (const pid_t *p = pids; *p; p++)
+        total += status_field_kb(*p, "RssAnon:");
+    return total;
+}
+
+/* private anonymous mappings only: file-backed pages would be cheap to drop anyway */
+static bool is_anon_mapping(const char *line)
+{
+    char perms[5];
+    unsigned long inode;
+    int path_offset = 0;
+    if (sscanf(line, "%*x-%*x %4s %*x %*x:%*x %lu %n", perms, &inode, &path_offset) < 2)
+        return false;
+    if (perms[3] != 'p' || inode != 0)
+        return false;
+    const char *path = line + path_offset;
+    return *path == '\0' || *path == '\n' || g_str_has_prefix(path, "[heap]") || g_str_has_prefix(path, "[stack]");
+}
+
+static int madvise_anon(pid_t pid, int advice)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/maps", pid);
+    FILE *maps = fopen(path, "re");
+    if (!maps)
+        return -errno;
+
+    CLEANUP(close_fd) int pidfd = pidfd_open(pid, 0);
+    if (pidfd < 0) {
+        int err = errno;
+        fclose(maps);
+        return -err;
+    }
+
+    struct iovec iov[IOV_MAX];
+    size_t n = 0;
+    int rv = 0;
+    char *line = NULL;
+    size_t linesz = 0;
+    while (getline(&line, &linesz, maps) > 0) {
+        if (!is_anon_mapping(line))
+            continue;
+        unsigned long start, end;
+        if (sscanf(line, "%lx-%lx", &start, &end) != 2)
+            continue;
+        iov[n].iov_base = (void *)start;
+        iov[n].iov_len = end - start;
+        if (++n == G_N_ELEMENTS(iov)) {
+            if (process_madvise(pidfd, iov, n, advice, 0) < 0) {
+                rv = -errno;
+                break;
+            }
+            n = 0;
+        }
+    }
+    if (!rv && n && process_madvise(pidfd, iov, n, advice, 0) < 0)
+        rv = -errno;
+
+    free(line);
+    fclose(maps);
+    return rv;
+}
+
+static bool pid_in_list(const pid_t *pids, pid_t pid)
+{
+    for (const pid_t *p = pids; *p; p++)
+        if (*p == pid)
+            return true;
+    return false;
+}
+
+/*
+ * memory.reclaim acts on the whole cgroup, so only use it when the cgroup
+ * holds nothing but the frozen processes. Otherwise we'd page out sway itself
+ * when the app shares the session scope.
+ */
+static bool reclaim_cgroup(const pid_t *pids, long kb)
+{
+    g_autofree char *dir = pid_cgroup_dir(pids[0]);
+    if (!dir)
+        return false;
+
+    g_autofree char *procs_path = g_build_filename(dir, "cgroup.procs", NULL);
+    g_autofree char *procs = NULL;
+    if (!g_file_get_contents(procs_path, &procs, NULL, NULL))
+        return false;
+    g_auto(GStrv) lines = g_strsplit(procs, "\n", -1);
+    for (char **l = lines; *l; l++) {
+        if (**l && !pid_in_list(pids, strtol(*l, NULL, 10)))
+            return false;
+    }
+
+    g_autofree char *reclaim_path = g_build_filename(dir, "memory.reclaim", NULL);
+    CLEANUP(close_fd) int fd = open(reclaim_path, O_WRONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    char amount[32];
+    int len = snprintf(amount, sizeof(amount), "%ldK", kb);
+    /* EAGAIN means the kernel reclaimed less than asked, which is fine */
+    if (write(fd, amount, len) < 0 && errno != EAGAIN)
+        return false;
+    return true;
+}
+
+long reclaim_memory(const pid_t *pids)
+{
+    if (!*pids)
+        return 0;
+
+    long before = rss_anon_kb(pids);
+    if (!before)
+        return 0;
+
+    int err = 0;
+    for (const pid_t *p = pids; *p; p++) {
+        err = madvise_anon(*p, MADV_PAGEOUT);
+        /* process_madvise needs CAP_SYS_NICE, no point in trying the rest */
+        if (err == -EPERM || err == -ENOSYS)
+            break;
+    }
+    if ((err == -EPERM || err == -ENOSYS) && !reclaim_cgroup(pids, before))
+        return -1;
+
+    long after = rss_anon_kb(pids);
+    return before > after ? before - after : 0;
+}
+
+bool prefetch_memory(const pid_t *pids)
+{
+    for (const pid_t *p = pids; *p; p++) {
+        /* swap readahead is queued, the faults are taken by the kernel rather than the app */
+        int err = madvise_anon(*p, MADV_WILLNEED);
+        /* process_madvise needs CAP_SYS_NICE, no point in trying the rest */
+        if (err == -EPERM || err == -ENOSYS || err == -EINVAL)
+            return false;
+    }
+    return true;
+}
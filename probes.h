@@ -0,0 +1,14 @@
+#pragma once
+
+/*
+ * Static tracepoints, enabled with -Dusdt=enabled. List them with
+ * `bpftrace -l 'usdt:./build/sway-freezer:*'`, see bpftrace/ for scripts.
+ */
+#ifdef HAVE_USDT
+#include <sys/sdt.h>
+#define FREEZER_PROBE(name, ...) STAP_PROBEV(sway_freezer, name, ##__VA_ARGS__)
+#else
+#define FREEZER_PROBE(name, ...) \
+    do {                         \
+    } while (0)
+#endif
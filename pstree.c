@@ -1,19 +1,21 @@
 #define _GNU_SOURCE
+#define ARENA_IMPLEMENTATION
 #include "arena.h"
 #include "freezer.h"
+#include "probes.h"
 #include <assert.h>
 #include <ctype.h>
 #include <dirent.h>
 #include <fcntl.h>
 #include <glib.h>
 #include <liburing.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
-G_DEFINE_AUTO_CLEANUP_CLEAR_FUNC(Arena, arena_free)
-
 struct submit_data {
     pid_t pid;
     char *path;
@@ -28,7 +30,51 @@ static int filter_pids(const struct dirent *dent)
     while (*x)
         if (!isdigit(*x++))
             return 0;
-    return 1;
+
+    /*
+     * Skip processes of other users (and kernel threads, owned by root)
+     * before reading anything: we can't signal them anyway. A stat is much
+     * cheaper than reading /proc/<pid>/stat. Foreign processes linking our
+     * own ones are picked up afterwards, see link_foreign_parents().
+     */
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%s", dent->d_name);
+    struct stat st;
+    return stat(path, &st) == 0 && st.st_uid == getuid();
+}
+
+/*
+ * /proc/<pid> of a non-dumpable process is owned by root, whoever runs it,
+ * so fall back to the real uid from status for those.
+ */
+static bool is_own_process(int procfd, const char *name, uid_t uid)
+{
+    struct stat st;
+    if (fstatat(procfd, name, &st, 0) < 0)
+        return false;
+    if (st.st_uid == uid)
+        return true;
+
+    char path[32];
+    snprintf(path, sizeof(path), "%s/status", name);
+    CLEANUP(close_fd) int fd = openat(procfd, path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    char buf[4096];
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    if (n <= 0)
+        return false;
+    buf[n] = '\0';
+    const char *x = strstr(buf, "\nUid:");
+    return x && strtoul(x + strlen("\nUid:"), NULL, 10) == uid;
+}
+
+static pid_t parse_pid(const char *filename)
+{
+    char *endptr = NULL;
+    pid_t pid = strtoul(filename, &endptr, 10);
+    assert(*filename != '\0' && *endptr == '\0');
+    return pid;
 }
 
 static int create_sqe(struct io_uring *ring, int procfd, int idx, const char *filename, Arena *arena)
@@ -37,11 +83,9 @@ static int create_sqe(struct io_uring *ring, int procfd, int idx, const char *fi
 
     struct submit_data *data = arena_alloc(arena, sizeof(*data));
     assert(data != NULL);
-    data->path = arena_sprintf(arena, "%s/status", filename);
+    data->path = arena_sprintf(arena, "%s/stat", filename);
 
-    char *endptr = NULL;
-    data->pid = strtoul(filename, &endptr, 10);
-    assert(*filename != '\0' && *endptr == '\0');
+    data->pid = parse_pid(filename);
 
     struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
     if (!sqe)
@@ -55,7 +99,7 @@ static int create_sqe(struct io_uring *ring, int procfd, int idx, const char *fi
         return -1;
     ++count;
     sqe2->flags |= (IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK);
-    io_uring_prep_read(sqe2, idx, data->buf, sizeof(data->buf), 0);
+    io_uring_prep_read(sqe2, idx, data->buf, sizeof(data->buf) - 1, 0);
     io_uring_sqe_set_data(sqe2, data);
 
     struct io_uring_sqe *sqe3 = io_uring_get_sqe(ring);
@@ -67,12 +111,6 @@ static int create_sqe(struct io_uring *ring, int procfd, int idx, const char *fi
     return count;
 }
 
-static void close_fd(int *fd)
-{
-    if (fd && *fd >= 0)
-        close(*fd);
-}
-
 static void free_namelist(struct dirent **namelist, int count)
 {
     while (count--)
@@ -80,41 +118,98 @@ static void free_namelist(struct dirent **namelist, int count)
     free(namelist);
 }
 
-static pid_t parse_ppid(const char *buf)
+/* comm may contain spaces and parens, so fields are counted from the last ')' */
+static const char *stat_field(const char *buf, int field)
 {
-    char *x = strstr(buf, "PPid:");
-    assert(x != NULL);
-    x += strlen("PPid:");
-    while (*x == ' ')
-        ++x;
-    assert(*x != '\0');
+    const char *x = strrchr(buf, ')');
+    if (!x)
+        return NULL;
+    /* state (field 3) follows ") " */
+    for (int i = 2; i < field; i++) {
+        x = strchr(x + 1, ' ');
+        if (!x)
+            return NULL;
+    }
+    return x + 1;
+}
+
+struct proc_stat {
+    pid_t ppid;
+    uint64_t cpu_ticks;
+    char comm[16];
+    /* only links its children into the tree, we couldn't signal it */
+    bool foreign;
+};
+
+static bool parse_stat(const char *buf, struct proc_stat *st)
+{
+    const char *comm = strchr(buf, '(');
+    const char *comm_end = strrchr(buf, ')');
+    const char *ppid = stat_field(buf, 4);
+    const char *utime = stat_field(buf, 14);
+    if (!comm || !comm_end || comm_end < comm || !ppid || !utime)
+        return false;
+
+    st->ppid = strtoul(ppid, NULL, 10);
     char *endptr = NULL;
-    pid_t ppid = strtoul(x, &endptr, 10);
-    assert(*endptr == '\0' || *endptr == '\n');
-    return ppid;
+    st->cpu_ticks = strtoull(utime, &endptr, 10);
+    st->cpu_ticks += strtoull(endptr, NULL, 10);
+    g_strlcpy(st->comm, comm + 1, MIN(sizeof(st->comm), comm_end - comm));
+    st->foreign = false;
+    return true;
 }
 
-static GHashTable *get_pid_relationships(Arena *arena, pid_t pid)
+struct scan_result {
+    Arena *arena;
+    /* ppid -> GList of pids */
+    GHashTable *pidmap;
+    /* pid -> struct proc_stat */
+    GHashTable *stats;
+};
+
+static void record_process(struct scan_result *res, pid_t pid, const struct proc_stat *st)
 {
-    CLEANUP(close_fd) int procfd = open("/proc", O_RDONLY | O_DIRECTORY);
-    if (procfd < 0) {
-        perror("/proc");
-        return NULL;
-    }
+    /* don't bother with kernel threads */
+    if (!st->ppid)
+        return;
+    g_hash_table_insert(res->stats, GUINT_TO_POINTER(pid), arena_memdup(res->arena, (void *)st, sizeof(*st)));
+    GList *pids = g_hash_table_lookup(res->pidmap, GUINT_TO_POINTER(st->ppid));
+    if (!pids) {
+        pids = g_list_append(NULL, GUINT_TO_POINTER(pid));
+        g_hash_table_insert(res->pidmap, GUINT_TO_POINTER(st->ppid), pids);
+    } else
+        pids = g_list_append(pids, GUINT_TO_POINTER(pid));
+}
 
-    struct dirent **namelist;
-    int count = scandirat(procfd, ".", &namelist, filter_pids, NULL);
-    if (count < 0) {
-        perror("scandirat");
-        return NULL;
-    }
+/*
+ * A scan backend reads the stat file of every entry in namelist and records
+ * it in the scan result. Processes that vanish during the scan are skipped.
+ */
+struct scan_backend {
+    const char *name;
+    bool (*probe)(void);
+    bool (*scan)(struct scan_result *res, int procfd, struct dirent **namelist, int count);
+};
+
+static bool probe_uring(void)
+{
+    /* seccomp profiles and kernel.io_uring_disabled make this fail */
+    struct io_uring ring;
+    int rv = io_uring_queue_init(8, &ring, IORING_SETUP_SINGLE_ISSUER);
+    if (rv < 0)
+        return false;
+    io_uring_queue_exit(&ring);
+    return true;
+}
 
+static bool scan_uring(struct scan_result *res, int procfd, struct dirent **namelist, int count)
+{
+    Arena *arena = res->arena;
     CLEANUP(io_uring_queue_exit) struct io_uring ring;
     int rv = io_uring_queue_init(count * 3, &ring, IORING_SETUP_SINGLE_ISSUER);
     if (rv < 0) {
         ring_perror(rv, "io_uring_queue_init");
-        free_namelist(namelist, count);
-        return NULL;
+        return false;
     }
 
     int pending = 0;
@@ -127,25 +222,22 @@ static GHashTable *get_pid_relationships(Arena *arena, pid_t pid)
         pending += n_sqe;
     }
 
-    free_namelist(namelist, count);
-
     int *fds = arena_alloc(arena, count * sizeof(fds[0]));
     assert(fds != NULL);
     memset(fds, -1, count * sizeof(fds[0]));
     int ret = io_uring_register_files(&ring, fds, count);
     if (ret < 0) {
         ring_perror(ret, "io_uring_register_files");
-        return NULL;
+        return false;
     }
 
     rv = io_uring_submit(&ring);
     if (rv < 0) {
         ring_perror(rv, "io_uring_submit");
-        return NULL;
+        return false;
     }
 
     struct io_uring_cqe *cqes[count];
-    GHashTable *pidmap = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)g_list_free);
 
     while (pending > 0) {
         int n_cqes = io_uring_peek_batch_cqe(&ring, cqes, count);
@@ -153,7 +245,7 @@ static GHashTable *get_pid_relationships(Arena *arena, pid_t pid)
             ret = io_uring_wait_cqe_nr(&ring, &cqes[0], pending);
             if (ret < 0) {
                 ring_perror(ret, "io_uring_wait_cqe");
-                goto err;
+                return false;
             }
             n_cqes = 1;
         }
@@ -165,20 +257,14 @@ static GHashTable *get_pid_relationships(Arena *arena, pid_t pid)
             if (cqe->res < 0) {
                 if (cqe->res != -ENOENT && cqe->res != -ECANCELED && cqe->res != -ESRCH) {
                     ring_perror(cqe->res, "cqe result");
-                    goto err;
+                    return false;
                 }
             } else if (data) {
                 assert(cqe->res > 0);
-                pid_t ppid = parse_ppid(data->buf);
-                /* don't bother with kernel threads */
-                if (ppid) {
-                    GList *pids = g_hash_table_lookup(pidmap, GUINT_TO_POINTER(ppid));
-                    if (!pids) {
-                        pids = g_list_append(NULL, GUINT_TO_POINTER(data->pid));
-                        g_hash_table_insert(pidmap, GUINT_TO_POINTER(ppid), pids);
-                    } else
-                        pids = g_list_append(pids, GUINT_TO_POINTER(data->pid));
-                }
+                data->buf[cqe->res] = '\0';
+                struct proc_stat st;
+                if (parse_stat(data->buf, &st))
+                    record_process(res, data->pid, &st);
             }
 
             io_uring_cqe_seen(&ring, cqe);
@@ -186,29 +272,239 @@ static GHashTable *get_pid_relationships(Arena *arena, pid_t pid)
         }
     }
 
-    return pidmap;
+    return true;
+}
+
+static bool probe_always(void) { return true; }
 
-err:
-    g_hash_table_unref(pidmap);
-    return NULL;
+/* returns false if the process is gone */
+static bool read_proc_stat(int procfd, const char *filename, struct proc_stat *st)
+{
+    char path[32];
+    snprintf(path, sizeof(path), "%s/stat", filename);
+    CLEANUP(close_fd) int fd = openat(procfd, path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    char buf[4096];
+    ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+    if (n <= 0)
+        return false;
+    buf[n] = '\0';
+    return parse_stat(buf, st);
 }
 
-pid_t *get_pid_children(pid_t pid)
+static bool scan_sync(struct scan_result *res, int procfd, struct dirent **namelist, int count)
 {
-    g_auto(Arena) arena = {0};
+    for (int i = 0; i < count; i++) {
+        const char *filename = namelist[i]->d_name;
+        struct proc_stat st;
+        if (read_proc_stat(procfd, filename, &st))
+            record_process(res, parse_pid(filename), &st);
+    }
+    return true;
+}
+
+#define SCAN_CHUNK 64
+#define SCAN_MAX_THREADS 8
 
-    g_autoptr(GHashTable) pidmap = get_pid_relationships(&arena, pid);
-    if (!pidmap)
+/* counts down the chunks of one scan */
+struct scan_wait {
+    GMutex lock;
+    GCond done;
+    int pending;
+};
+
+struct scan_chunk {
+    int procfd;
+    struct dirent **namelist;
+    struct proc_stat *stats;
+    int start;
+    int end;
+    struct scan_wait *wait;
+};
+
+/* created by the first probe and kept, so scans don't spawn and join threads */
+static GThreadPool *scan_pool;
+
+static void scan_chunk_func(gpointer data, gpointer user_data)
+{
+    struct scan_chunk *chunk = data;
+    for (int i = chunk->start; i < chunk->end; i++) {
+        /* a zero ppid marks vanished processes, same as kernel threads */
+        if (!read_proc_stat(chunk->procfd, chunk->namelist[i]->d_name, &chunk->stats[i]))
+            chunk->stats[i].ppid = 0;
+    }
+
+    struct scan_wait *wait = chunk->wait;
+    g_mutex_lock(&wait->lock);
+    if (!--wait->pending)
+        g_cond_signal(&wait->done);
+    g_mutex_unlock(&wait->lock);
+}
+
+static bool probe_threads(void)
+{
+    if (scan_pool)
+        return true;
+    int n_threads = MIN(g_get_num_processors(), SCAN_MAX_THREADS);
+    g_autoptr(GError) error = NULL;
+    scan_pool = g_thread_pool_new(scan_chunk_func, NULL, n_threads, true, &error);
+    if (!scan_pool) {
+        fprintf(stderr, "g_thread_pool_new: %s\n", error->message);
+        return false;
+    }
+    return true;
+}
+
+static bool scan_threads(struct scan_result *res, int procfd, struct dirent **namelist, int count)
+{
+    struct scan_wait wait = {.pending = (count + SCAN_CHUNK - 1) / SCAN_CHUNK};
+    g_mutex_init(&wait.lock);
+    g_cond_init(&wait.done);
+
+    /* each worker writes only its own slots, no locking needed */
+    struct proc_stat *stats = arena_alloc(res->arena, count * sizeof(stats[0]));
+    assert(stats != NULL);
+    for (int start = 0; start < count; start += SCAN_CHUNK) {
+        struct scan_chunk *chunk = arena_alloc(res->arena, sizeof(*chunk));
+        assert(chunk != NULL);
+        *chunk = (struct scan_chunk){
+            .procfd = procfd,
+            .namelist = namelist,
+            .stats = stats,
+            .start = start,
+            .end = MIN(start + SCAN_CHUNK, count),
+            .wait = &wait,
+        };
+        g_thread_pool_push(scan_pool, chunk, NULL);
+    }
+
+    g_mutex_lock(&wait.lock);
+    while (wait.pending)
+        g_cond_wait(&wait.done, &wait.lock);
+    g_mutex_unlock(&wait.lock);
+    g_cond_clear(&wait.done);
+    g_mutex_clear(&wait.lock);
+
+    for (int i = 0; i < count; i++)
+        record_process(res, parse_pid(namelist[i]->d_name), &stats[i]);
+    return true;
+}
+
+/* in order of preference */
+static const struct scan_backend scan_backends[] = {
+    {"io_uring", probe_uring, scan_uring},
+    {"threads", probe_threads, scan_threads},
+    {"sync", probe_always, scan_sync},
+};
+
+static const struct scan_backend *scan_backend;
+
+bool pstree_set_backend(const char *name)
+{
+    for (int i = 0; i < G_N_ELEMENTS(scan_backends); i++) {
+        const struct scan_backend *b = &scan_backends[i];
+        if (name && strcmp(name, b->name))
+            continue;
+        if (!b->probe()) {
+            g_debug("%s scan backend unavailable", b->name);
+            continue;
+        }
+        scan_backend = b;
+        g_debug("using %s scan backend", b->name);
+        return true;
+    }
+    return false;
+}
+
+const char *pstree_backend_name(void) { return scan_backend ? scan_backend->name : NULL; }
+
+/*
+ * A foreign process in the middle of an app's tree (e.g. a setuid helper)
+ * still has to link its children to the app. Parents of scanned processes
+ * that the owner filter skipped are few, so read just those, up the chain
+ * until a known process.
+ */
+static void link_foreign_parents(struct scan_result *res, int procfd)
+{
+    uid_t uid = getuid();
+    /* every ppid in pidmap is either scanned or in here */
+    g_autoptr(GArray) missing = g_array_new(false, false, sizeof(pid_t));
+    GHashTableIter iter;
+    gpointer key;
+    g_hash_table_iter_init(&iter, res->pidmap);
+    while (g_hash_table_iter_next(&iter, &key, NULL)) {
+        pid_t ppid = GPOINTER_TO_UINT(key);
+        if (ppid > 1 && !g_hash_table_contains(res->stats, key))
+            g_array_append_val(missing, ppid);
+    }
+
+    for (guint i = 0; i < missing->len; i++) {
+        pid_t pid = g_array_index(missing, pid_t, i);
+        char name[16];
+        snprintf(name, sizeof(name), "%d", pid);
+        struct proc_stat st;
+        if (!read_proc_stat(procfd, name, &st))
+            continue;
+        /* non-dumpable processes of ours look foreign too */
+        st.foreign = !is_own_process(procfd, name, uid);
+        if (st.ppid > 1 && !g_hash_table_contains(res->pidmap, GUINT_TO_POINTER(st.ppid)))
+            g_array_append_val(missing, st.ppid);
+        record_process(res, pid, &st);
+    }
+    if (missing->len)
+        g_debug("read %u parents of other users", missing->len);
+}
+
+static bool scan_processes(struct scan_result *res, int procfd)
+{
+    if (!scan_backend && !pstree_set_backend(NULL))
+        return false;
+
+    struct dirent **namelist;
+    int count = scandirat(procfd, ".", &namelist, filter_pids, NULL);
+    if (count < 0) {
+        perror("scandirat");
+        return false;
+    }
+    g_debug("scanning %d processes", count);
+
+    bool ok = scan_backend->scan(res, procfd, namelist, count);
+    free_namelist(namelist, count);
+    if (ok)
+        link_foreign_parents(res, procfd);
+    return ok;
+}
+
+static GArray *collect_children(Arena *arena, pid_t pid)
+{
+    g_autoptr(GHashTable) pidmap = g_hash_table_new_full(NULL, NULL, NULL, (GDestroyNotify)g_list_free);
+    g_autoptr(GHashTable) stats = g_hash_table_new(NULL, NULL);
+    struct scan_result res = {.arena = arena, .pidmap = pidmap, .stats = stats};
+    CLEANUP(close_fd) int procfd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (procfd < 0) {
+        perror("/proc");
+        return NULL;
+    }
+    if (!scan_processes(&res, procfd))
         return NULL;
 
-    GArray *result = g_array_new(true, false, sizeof(pid_t));
+    GArray *result = g_array_new(true, true, sizeof(struct proc_sample));
 
     g_autoptr(GQueue) queue = g_queue_new();
     g_queue_push_head(queue, GUINT_TO_POINTER(pid));
 
     while (!g_queue_is_empty(queue)) {
         pid_t p = GPOINTER_TO_UINT(g_queue_pop_tail(queue));
-        g_array_append_val(result, p);
+        struct proc_stat *st = g_hash_table_lookup(stats, GUINT_TO_POINTER(p));
+        if (p == pid || !st || !st->foreign) {
+            struct proc_sample sample = {.pid = p};
+            if (st) {
+                sample.cpu_ticks = st->cpu_ticks;
+                memcpy(sample.comm, st->comm, sizeof(sample.comm));
+            }
+            g_array_append_val(result, sample);
+        }
 
         GList *children = g_hash_table_lookup(pidmap, GUINT_TO_POINTER(p));
         if (children) {
@@ -217,5 +513,205 @@ pid_t *get_pid_children(pid_t pid)
         }
     }
 
+    return result;
+}
+
+struct proc_sample *get_pid_samples(pid_t pid)
+{
+    /* kept across scans and sized from the largest one, so steady-state scans don't allocate regions */
+    static Arena arena;
+    FREEZER_PROBE(scan_start, pid);
+    GArray *result = collect_children(&arena, pid);
+    arena_reset_fit(&arena);
+    FREEZER_PROBE(scan_end, pid, result ? (int)result->len : 0);
+    return result ? (struct proc_sample *)g_array_free(result, false) : NULL;
+}
+
+pid_t *get_pid_children(pid_t pid)
+{
+    g_autofree struct proc_sample *samples = get_pid_samples(pid);
+    if (!samples)
+        return NULL;
+
+    GArray *result = g_array_new(true, false, sizeof(pid_t));
+    for (struct proc_sample *s = samples; s->pid; s++)
+        g_array_append_val(result, s->pid);
     return (pid_t *)g_array_free(result, false);
 }
+
+static bool children_supported(void)
+{
+    static int supported = -1;
+    if (supported < 0) {
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/self/task/%d/children", gettid());
+        supported = access(path, R_OK) == 0;
+        if (!supported)
+            g_debug("no /proc/<pid>/task/<tid>/children, freezes won't chase new children");
+    }
+    return supported;
+}
+
+/* appends the children of every thread of pid */
+static void read_children(int procfd, pid_t pid, GArray *out)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "%d/task", pid);
+    int taskfd = openat(procfd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (taskfd < 0)
+        return;
+    DIR *dir = fdopendir(taskfd);
+    if (!dir) {
+        close(taskfd);
+        return;
+    }
+    struct dirent *dent;
+    while ((dent = readdir(dir))) {
+        if (dent->d_name[0] == '.')
+            continue;
+        snprintf(path, sizeof(path), "%s/children", dent->d_name);
+        CLEANUP(close_fd) int fd = openat(taskfd, path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            continue;
+        char buf[4096];
+        ssize_t n;
+        size_t len = 0;
+        /* a pid may straddle two reads, so carry the unparsed tail over */
+        while ((n = read(fd, buf + len, sizeof(buf) - 1 - len)) > 0) {
+            len += n;
+            buf[len] = '\0';
+            char *x = buf, *endptr;
+            while (true) {
+                pid_t child = strtoul(x, &endptr, 10);
+                if (endptr == x || !*endptr)
+                    break;
+                g_array_append_val(out, child);
+                x = endptr;
+            }
+            len = strlen(x);
+            memmove(buf, x, len);
+        }
+        if (len) {
+            buf[len] = '\0';
+            pid_t child = strtoul(buf, NULL, 10);
+            if (child)
+                g_array_append_val(out, child);
+        }
+    }
+    closedir(dir);
+}
+
+int stop_pids(pid_t **pids, const pid_t *known, int max_rounds, pids_func before_stop, void *user_data)
+{
+    /* everything stopped, plus what the caller chose to leave running */
+    g_autoptr(GHashTable) seen = g_hash_table_new(NULL, NULL);
+    GArray *all = g_array_new(true, false, sizeof(pid_t));
+    for (pid_t *p = *pids; *p; p++) {
+        if (g_hash_table_add(seen, GUINT_TO_POINTER(*p)))
+            g_array_append_val(all, *p);
+    }
+    g_free(*pids);
+    for (const pid_t *p = known; p && *p; p++)
+        g_hash_table_add(seen, GUINT_TO_POINTER(*p));
+
+    CLEANUP(close_fd) int procfd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    uid_t uid = getuid();
+    guint signalled = 0;
+    int rounds = 0;
+    bool converged = true;
+    while (true) {
+        /* the array is zero-terminated, so the batch ends where all does */
+        if (before_stop)
+            before_stop(&g_array_index(all, pid_t, signalled), user_data);
+        for (guint i = signalled; i < all->len; i++) {
+            if (kill(g_array_index(all, pid_t, i), SIGSTOP) < 0 && errno != ESRCH)
+                perror("kill");
+        }
+        signalled = all->len;
+
+        if (procfd < 0 || !children_supported() || rounds == max_rounds)
+            break;
+        rounds++;
+
+        /*
+         * A stopped parent can't fork anymore, but the stop only lands once
+         * the signal is delivered: other threads of the process may still
+         * be forking. Look for children we haven't seen below all of them.
+         */
+        g_autoptr(GArray) children = g_array_new(false, false, sizeof(pid_t));
+        for (guint i = 0; i < all->len; i++)
+            read_children(procfd, g_array_index(all, pid_t, i), children);
+        for (guint i = 0; i < children->len; i++) {
+            pid_t child = g_array_index(children, pid_t, i);
+            if (!g_hash_table_add(seen, GUINT_TO_POINTER(child)))
+                continue;
+            /* e.g. a setuid helper, we couldn't stop it */
+            char name[16];
+            snprintf(name, sizeof(name), "%d", child);
+            if (is_own_process(procfd, name, uid))
+                g_array_append_val(all, child);
+        }
+        FREEZER_PROBE(stop_round, rounds, (int)(all->len - signalled));
+        if (all->len == signalled)
+            break;
+        /* the last newcomers get stopped, but their own children may escape */
+        if (rounds == max_rounds)
+            converged = false;
+    }
+
+    *pids = (pid_t *)g_array_free(all, false);
+    return converged ? rounds : -1;
+}
+
+/* reads /proc/<pid>/stat into a NUL-terminated buf */
+static bool read_pid_stat(pid_t pid, char *buf, size_t size)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+
+    CLEANUP(close_fd) int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    ssize_t n = read(fd, buf, size - 1);
+    if (n <= 0)
+        return false;
+    buf[n] = '\0';
+    return true;
+}
+
+static uint64_t proc_stat_field(pid_t pid, int field)
+{
+    char buf[1024];
+    if (!read_pid_stat(pid, buf, sizeof(buf)))
+        return 0;
+    const char *x = stat_field(buf, field);
+    return x ? strtoull(x, NULL, 10) : 0;
+}
+
+uint64_t proc_start_time(pid_t pid) { return proc_stat_field(pid, 22); }
+
+uint64_t proc_major_faults(const pid_t *pids)
+{
+    uint64_t total = 0;
+    for (const pid_t *p = pids; *p; p++)
+        total += proc_stat_field(*p, 12);
+    return total;
+}
+
+uint64_t proc_cpu_ticks(const pid_t *pids)
+{
+    uint64_t total = 0;
+    for (const pid_t *p = pids; *p; p++) {
+        char buf[1024];
+        if (!read_pid_stat(*p, buf, sizeof(buf)))
+            continue;
+        /* stime follows utime */
+        const char *x = stat_field(buf, 14);
+        if (!x)
+            continue;
+        char *endptr = NULL;
+        total += strtoull(x, &endptr, 10);
+        total += strtoull(endptr, NULL, 10);
+    }
+    return total;
+}
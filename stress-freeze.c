@@ -0,0 +1,156 @@
+/*
+ * Freezes a process tree that keeps forking and counts the processes that
+ * escape, with and without rescanning for new children:
+ *
+ *   stress-freeze [<forks per second> [<iterations>]]
+ */
+#define _GNU_SOURCE
+#include "freezer.h"
+#include <fcntl.h>
+#include <glib.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* threads forking in the root process, so a stop can land on one while another forks */
+#define FORKERS 4
+/* how long a forked process lives */
+#define LIFETIME_US 200000
+#define SETTLE_US 50000
+
+static const int max_rounds[] = {0, 8};
+
+static void *forker(void *data)
+{
+    long interval_us = GPOINTER_TO_SIZE(data);
+    while (true) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            usleep(interval_us);
+            continue;
+        }
+        if (!pid) {
+            /* every other process forks once more, so freezes need to chase grandchildren too */
+            if (getpid() % 2 && !fork())
+                usleep(LIFETIME_US / 2);
+            else
+                usleep(LIFETIME_US);
+            _exit(0);
+        }
+        usleep(interval_us);
+    }
+    return NULL;
+}
+
+static void run_storm(int rate)
+{
+    /* exited children are reaped by the kernel */
+    signal(SIGCHLD, SIG_IGN);
+    for (int i = 0; i < FORKERS; i++)
+        g_thread_new("forker", forker, GSIZE_TO_POINTER((long)G_USEC_PER_SEC * FORKERS / rate));
+    while (true)
+        pause();
+}
+
+static char proc_state(pid_t pid)
+{
+    char path[64], buf[1024];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return 0;
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0)
+        return 0;
+    buf[n] = '\0';
+    char *x = strrchr(buf, ')');
+    return x && x[1] ? x[2] : 0;
+}
+
+static int count_escaped(const pid_t *pids)
+{
+    int n = 0;
+    for (const pid_t *p = pids; *p; p++) {
+        char state = proc_state(*p);
+        if (state && state != 'T' && state != 'Z' && state != 'X')
+            n++;
+    }
+    return n;
+}
+
+static int count_pids(const pid_t *pids)
+{
+    int n = 0;
+    while (pids[n])
+        n++;
+    return n;
+}
+
+int main(int argc, char *argv[])
+{
+    int rate = argc > 1 ? atoi(argv[1]) : 2000;
+    int iterations = argc > 2 ? atoi(argv[2]) : 20;
+    if (rate <= 0 || iterations <= 0) {
+        fprintf(stderr, "usage: stress-freeze [<forks per second> [<iterations>]]\n");
+        return 1;
+    }
+
+    pid_t root = fork();
+    if (root < 0) {
+        perror("fork");
+        return 1;
+    }
+    if (!root) {
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        run_storm(rate);
+    }
+
+    printf("%d forks/s, %d iterations\n", rate, iterations);
+    for (int m = 0; m < G_N_ELEMENTS(max_rounds); m++) {
+        long escaped = 0, procs = 0, worst = 0;
+        gint64 total = 0, slowest = 0;
+        int unconverged = 0;
+        for (int i = 0; i < iterations; i++) {
+            /* let the storm get going again after the last thaw */
+            usleep(LIFETIME_US);
+
+            pid_t *pids = get_pid_children(root);
+            if (!pids) {
+                fprintf(stderr, "can't scan /proc\n");
+                return 1;
+            }
+            gint64 start = g_get_monotonic_time();
+            if (stop_pids(&pids, NULL, max_rounds[m], NULL, NULL) < 0)
+                unconverged++;
+            gint64 elapsed = g_get_monotonic_time() - start;
+            total += elapsed;
+            slowest = MAX(slowest, elapsed);
+            procs += count_pids(pids);
+            g_free(pids);
+
+            /* anything below root that's still running got away */
+            usleep(SETTLE_US);
+            g_autofree pid_t *after = get_pid_children(root);
+            int n = after ? count_escaped(after) : 0;
+            escaped += n;
+            worst = MAX(worst, n);
+
+            for (pid_t *p = after; p && *p; p++)
+                kill(*p, SIGCONT);
+        }
+        printf("%2d rescans: %6.1f stopped, %5.1f escaped (worst %ld), freeze mean %6ld us max %6ld us, "
+               "%d unconverged\n",
+               max_rounds[m], (double)procs / iterations, (double)escaped / iterations, worst,
+               (long)(total / iterations), (long)slowest, unconverged);
+    }
+
+    kill(root, SIGKILL);
+    waitpid(root, NULL, 0);
+    return 0;
+}
@@ -0,0 +1,332 @@
+#define _GNU_SOURCE
+#include "freezer.h"
+#include "ipc-client.h"
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Single-pass walker over a GET_TREE reply. Instead of building a DOM it
+ * scans the reply bytes once, decodes the few strings it cares about in place
+ * and calls back for every view (a leaf container with a pid). Records point
+ * into the reply buffer, so they're valid for as long as the buffer is.
+ */
+
+struct tree_parser {
+    char *p;
+    char *end;
+    int depth;
+    sway_window_func cb;
+    void *user_data;
+};
+
+static void __attribute__((noreturn)) parse_error(struct tree_parser *ps, const char *what)
+{
+    die("failed to parse sway tree: %s at '%.16s'", what, ps->p < ps->end ? ps->p : "");
+}
+
+static void skip_ws(struct tree_parser *ps)
+{
+    while (ps->p < ps->end && (*ps->p == ' ' || *ps->p == '\n' || *ps->p == '\r' || *ps->p == '\t'))
+        ps->p++;
+}
+
+static bool consume(struct tree_parser *ps, char c)
+{
+    skip_ws(ps);
+    if (ps->p < ps->end && *ps->p == c) {
+        ps->p++;
+        return true;
+    }
+    return false;
+}
+
+static void expect(struct tree_parser *ps, char c)
+{
+    if (!consume(ps, c))
+        parse_error(ps, "unexpected character");
+}
+
+static bool consume_literal(struct tree_parser *ps, const char *lit)
+{
+    size_t n = strlen(lit);
+    if ((size_t)(ps->end - ps->p) < n || memcmp(ps->p, lit, n))
+        return false;
+    ps->p += n;
+    return true;
+}
+
+static int hex_digit(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+static uint32_t parse_hex4(struct tree_parser *ps)
+{
+    if (ps->end - ps->p < 4)
+        parse_error(ps, "truncated escape");
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++) {
+        int d = hex_digit(*ps->p++);
+        if (d < 0)
+            parse_error(ps, "invalid escape");
+        v = (v << 4) | d;
+    }
+    return v;
+}
+
+static char *put_utf8(char *w, uint32_t cp)
+{
+    if (cp < 0x80) {
+        *w++ = cp;
+    } else if (cp < 0x800) {
+        *w++ = 0xc0 | (cp >> 6);
+        *w++ = 0x80 | (cp & 0x3f);
+    } else if (cp < 0x10000) {
+        *w++ = 0xe0 | (cp >> 12);
+        *w++ = 0x80 | ((cp >> 6) & 0x3f);
+        *w++ = 0x80 | (cp & 0x3f);
+    } else {
+        *w++ = 0xf0 | (cp >> 18);
+        *w++ = 0x80 | ((cp >> 12) & 0x3f);
+        *w++ = 0x80 | ((cp >> 6) & 0x3f);
+        *w++ = 0x80 | (cp & 0x3f);
+    }
+    return w;
+}
+
+/* decodes in place: escapes never expand, so the output fits where the input was */
+static char *parse_string(struct tree_parser *ps)
+{
+    expect(ps, '"');
+    char *start = ps->p;
+    char *w = start;
+    while (true) {
+        if (ps->p >= ps->end)
+            parse_error(ps, "unterminated string");
+        char c = *ps->p++;
+        if (c == '"')
+            break;
+        if (c != '\\') {
+            *w++ = c;
+            continue;
+        }
+        if (ps->p >= ps->end)
+            parse_error(ps, "unterminated string");
+        switch (c = *ps->p++) {
+        case 'b':
+            *w++ = '\b';
+            break;
+        case 'f':
+            *w++ = '\f';
+            break;
+        case 'n':
+            *w++ = '\n';
+            break;
+        case 'r':
+            *w++ = '\r';
+            break;
+        case 't':
+            *w++ = '\t';
+            break;
+        case 'u': {
+            uint32_t cp = parse_hex4(ps);
+            if (cp >= 0xd800 && cp < 0xdc00 && consume_literal(ps, "\\u")) {
+                uint32_t lo = parse_hex4(ps);
+                if (lo < 0xdc00 || lo >= 0xe000)
+                    parse_error(ps, "invalid surrogate pair");
+                cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+            }
+            w = put_utf8(w, cp);
+            break;
+        }
+        default:
+            *w++ = c;
+        }
+    }
+    /* the closing quote (or anything after w) has already been consumed */
+    *w = '\0';
+    return start;
+}
+
+static void skip_value(struct tree_parser *ps);
+
+static void skip_container(struct tree_parser *ps, char close, bool keys)
+{
+    if (++ps->depth > JSON_MAX_DEPTH)
+        parse_error(ps, "nesting too deep");
+    if (!consume(ps, close)) {
+        do {
+            if (keys) {
+                parse_string(ps);
+                expect(ps, ':');
+            }
+            skip_value(ps);
+        } while (consume(ps, ','));
+        expect(ps, close);
+    }
+    ps->depth--;
+}
+
+static void skip_value(struct tree_parser *ps)
+{
+    skip_ws(ps);
+    if (ps->p >= ps->end)
+        parse_error(ps, "unexpected end");
+    switch (*ps->p) {
+    case '{':
+        ps->p++;
+        skip_container(ps, '}', true);
+        return;
+    case '[':
+        ps->p++;
+        skip_container(ps, ']', false);
+        return;
+    case '"':
+        parse_string(ps);
+        return;
+    }
+    if (consume_literal(ps, "true") || consume_literal(ps, "false") || consume_literal(ps, "null"))
+        return;
+    char *endptr = NULL;
+    strtod(ps->p, &endptr);
+    if (endptr == ps->p)
+        parse_error(ps, "invalid value");
+    ps->p = endptr;
+}
+
+/* string or null */
+static const char *parse_nullable_string(struct tree_parser *ps, const char *name)
+{
+    skip_ws(ps);
+    if (consume_literal(ps, "null"))
+        return NULL;
+    if (ps->p >= ps->end || *ps->p != '"')
+        die("invalid type for '%s'", name);
+    return parse_string(ps);
+}
+
+static bool parse_bool(struct tree_parser *ps, const char *name)
+{
+    skip_ws(ps);
+    if (consume_literal(ps, "true"))
+        return true;
+    if (consume_literal(ps, "false"))
+        return false;
+    die("invalid type for '%s'", name);
+}
+
+static long long parse_int(struct tree_parser *ps, const char *name)
+{
+    skip_ws(ps);
+    char *endptr = NULL;
+    long long v = strtoll(ps->p, &endptr, 10);
+    if (endptr == ps->p || *endptr == '.' || *endptr == 'e' || *endptr == 'E')
+        die("invalid type for '%s'", name);
+    ps->p = endptr;
+    return v;
+}
+
+static const char *parse_window_class(struct tree_parser *ps)
+{
+    const char *class = NULL;
+    expect(ps, '{');
+    if (consume(ps, '}'))
+        return NULL;
+    do {
+        const char *key = parse_string(ps);
+        expect(ps, ':');
+        if (!strcmp(key, "class"))
+            class = parse_nullable_string(ps, "class");
+        else
+            skip_value(ps);
+    } while (consume(ps, ','));
+    expect(ps, '}');
+    return class;
+}
+
+static void parse_node(struct tree_parser *ps, const char *workspace);
+
+static void parse_nodes(struct tree_parser *ps, const char *workspace)
+{
+    expect(ps, '[');
+    if (consume(ps, ']'))
+        return;
+    do {
+        parse_node(ps, workspace);
+    } while (consume(ps, ','));
+    expect(ps, ']');
+}
+
+/*
+ * sway emits a node's own fields before "nodes" and "floating_nodes", so
+ * the workspace name is known by the time children are walked.
+ */
+static void parse_node(struct tree_parser *ps, const char *workspace)
+{
+    if (++ps->depth > JSON_MAX_DEPTH)
+        parse_error(ps, "nesting too deep");
+
+    struct window_info win = {.workspace = workspace};
+    const char *type = NULL;
+    const char *name = NULL;
+    bool has_pid = false, has_focused = false;
+
+    expect(ps, '{');
+    if (!consume(ps, '}')) {
+        do {
+            const char *key = parse_string(ps);
+            expect(ps, ':');
+            if (!strcmp(key, "type")) {
+                type = parse_nullable_string(ps, key);
+            } else if (!strcmp(key, "name")) {
+                name = parse_nullable_string(ps, key);
+            } else if (!strcmp(key, "app_id")) {
+                win.app_id = parse_nullable_string(ps, key);
+            } else if (!strcmp(key, "pid")) {
+                win.pid = parse_int(ps, key);
+                has_pid = true;
+            } else if (!strcmp(key, "focused")) {
+                win.focused = parse_bool(ps, key);
+                has_focused = true;
+            } else if (!strcmp(key, "inhibit_idle")) {
+                win.inhibit_idle = parse_bool(ps, key);
+            } else if (!strcmp(key, "window_properties")) {
+                win.class = parse_window_class(ps);
+            } else if (!strcmp(key, "nodes") || !strcmp(key, "floating_nodes")) {
+                bool is_workspace = type && !strcmp(type, "workspace");
+                parse_nodes(ps, is_workspace ? name : workspace);
+            } else {
+                skip_value(ps);
+            }
+        } while (consume(ps, ','));
+        expect(ps, '}');
+    }
+    ps->depth--;
+
+    /* only views have a pid; XWayland ones have a null app_id and a class instead */
+    if (!has_pid)
+        return;
+    if (!has_focused)
+        die("invalid type for 'focused'");
+    ps->cb(&win, ps->user_data);
+}
+
+void sway_tree_walk(char *buf, size_t len, sway_window_func cb, void *user_data)
+{
+    struct tree_parser ps = {
+        .p = buf,
+        .end = buf + len,
+        .cb = cb,
+        .user_data = user_data,
+    };
+    parse_node(&ps, NULL);
+    skip_ws(&ps);
+    if (ps.p != ps.end)
+        parse_error(&ps, "trailing data");
+}